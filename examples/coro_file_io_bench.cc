@@ -0,0 +1,165 @@
+#include <io_scheduler.h>
+#include <sync_wait.h>
+#include <task.h>
+#include <thread_pool.h>
+#include <when_all.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Random 4 KiB reads from a scratch file, issued as blocking pread() calls
+// on ThreadPool workers and as IOScheduler::read_at() on both backends. The
+// file is written with write_at(), fallocate() and fsync() first.
+using clock_type = std::chrono::steady_clock;
+
+static constexpr std::size_t block_size{4096};
+static constexpr std::size_t block_count{16384};
+
+static coro::Task<void> fill(coro::IOScheduler& scheduler, int fd)
+{
+	co_await scheduler.schedule();
+
+	if (auto result = co_await scheduler.fallocate(fd, 0, 0, block_size * block_count); result < 0)
+	{
+		// Not every file system supports it, the writes below extend the file anyway.
+		std::cout << "fallocate: " << -result << "\n";
+	}
+
+	std::vector<char> block(block_size);
+	for (std::size_t i = 0; i < block_count; ++i)
+	{
+		std::fill(block.begin(), block.end(), static_cast<char>(i));
+		if (co_await scheduler.write_at(fd, block.data(), block.size(), i * block_size) != block_size)
+		{
+			throw std::runtime_error{"short write"};
+		}
+	}
+
+	co_await scheduler.fsync(fd, true);
+}
+
+// The first byte of every block tells which block it is.
+static void check(const std::vector<char>& buffer, std::size_t block, std::atomic<std::size_t>& errors)
+{
+	if (buffer[0] != static_cast<char>(block))
+	{
+		errors.fetch_add(1, std::memory_order::relaxed);
+	}
+}
+
+static void report(const char* name, std::size_t reads, std::size_t errors, clock_type::time_point start)
+{
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+	std::cout << "  " << name << ": " << reads * 1000000000.0 / ns << " reads/s, "
+		<< static_cast<double>(ns) / reads << " ns/read, errors = " << errors << "\n";
+}
+
+static void run_thread_pool(int fd, std::size_t workers, std::size_t readers, std::size_t reads)
+{
+	coro::ThreadPool thread_pool{coro::ThreadPool::options{.thread_count = static_cast<uint32_t>(workers)}};
+	std::atomic<std::size_t> errors{0};
+
+	auto make_reader = [&](std::size_t seed) -> coro::Task<void>
+	{
+		co_await thread_pool.schedule();
+
+		std::minstd_rand rng{static_cast<uint32_t>(seed + 1)};
+		std::vector<char> buffer(block_size);
+		for (std::size_t i = 0; i < reads; ++i)
+		{
+			const std::size_t block = rng() % block_count;
+			if (::pread(fd, buffer.data(), block_size, block * block_size) != block_size)
+			{
+				errors.fetch_add(1, std::memory_order::relaxed);
+				continue;
+			}
+			check(buffer, block, errors);
+		}
+	};
+
+	std::vector<coro::Task<void>> tasks{};
+	for (std::size_t i = 0; i < readers; ++i)
+	{
+		tasks.emplace_back(make_reader(i));
+	}
+
+	const auto start = clock_type::now();
+	coro::sync_wait(coro::when_all(std::move(tasks)));
+	report("thread pool pread", readers * reads, errors.load(), start);
+}
+
+static void run_scheduler(int fd, coro::IOScheduler::Backend backend, std::size_t workers,
+		std::size_t readers, std::size_t reads)
+{
+	coro::IOScheduler scheduler{coro::IOScheduler::options{
+		.execution_strategy = coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_INLINE,
+		.backend = backend,
+		.file_threads = workers}};
+	std::atomic<std::size_t> errors{0};
+
+	auto make_reader = [&](std::size_t seed) -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+
+		std::minstd_rand rng{static_cast<uint32_t>(seed + 1)};
+		std::vector<char> buffer(block_size);
+		for (std::size_t i = 0; i < reads; ++i)
+		{
+			const std::size_t block = rng() % block_count;
+			if (co_await scheduler.read_at(fd, buffer.data(), block_size, block * block_size) != block_size)
+			{
+				errors.fetch_add(1, std::memory_order::relaxed);
+				continue;
+			}
+			check(buffer, block, errors);
+		}
+	};
+
+	std::vector<coro::Task<void>> tasks{};
+	for (std::size_t i = 0; i < readers; ++i)
+	{
+		tasks.emplace_back(make_reader(i));
+	}
+
+	const auto start = clock_type::now();
+	coro::sync_wait(coro::when_all(std::move(tasks)));
+	report(scheduler.backend() == coro::IOScheduler::Backend::IO_URING ? "io_uring read_at  " : "epoll read_at     ",
+			readers * reads, errors.load(), start);
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t reads = argc > 1 ? std::stoul(argv[1]) : 20000;
+	const std::size_t readers = argc > 2 ? std::stoul(argv[2]) : 32;
+	const std::size_t workers = argc > 3 ? std::stoul(argv[3]) : 4;
+
+	char path[] = "/tmp/coro_file_io_bench.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1)
+	{
+		std::cerr << "mkstemp failed\n";
+		return 1;
+	}
+	unlink(path);
+
+	{
+		coro::IOScheduler scheduler{coro::IOScheduler::options{
+			.execution_strategy = coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_INLINE}};
+		coro::sync_wait(fill(scheduler, fd));
+	}
+
+	std::cout << readers << " readers, " << reads << " reads each, " << workers << " threads\n";
+	run_thread_pool(fd, workers, readers, reads);
+	run_scheduler(fd, coro::IOScheduler::Backend::EPOLL, workers, readers, reads);
+	run_scheduler(fd, coro::IOScheduler::Backend::IO_URING, workers, readers, reads);
+
+	close(fd);
+}
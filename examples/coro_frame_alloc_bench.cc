@@ -0,0 +1,180 @@
+#include <task.h>
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Creates, awaits and destroys trees of small tasks, a request's worth of
+// 30 children per parent, with coro::Task and with a bare task type whose
+// frames come from global operator new. Then does the same for frames freed
+// on another thread than the one that created them. coro::Task frames only
+// go through the frame allocator's free lists with CORO_FRAME_ALLOCATOR.
+using clock_type = std::chrono::steady_clock;
+
+static constexpr std::size_t children{30};
+
+// The same lazy, symmetric transfer task without the frame allocator.
+template <typename T>
+class heap_task
+{
+	public:
+		struct promise_type
+		{
+			struct final_awaitable
+			{
+				bool await_ready() const noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+				{
+					return h.promise().continuation_;
+				}
+				void await_resume() noexcept {}
+			};
+
+			heap_task get_return_object() noexcept
+			{
+				return heap_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+			}
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			final_awaitable final_suspend() noexcept { return {}; }
+			void return_value(T value) noexcept { value_ = std::move(value); }
+			void unhandled_exception() { std::terminate(); }
+
+			std::coroutine_handle<> continuation_{std::noop_coroutine()};
+			T value_{};
+		};
+
+		explicit heap_task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+		heap_task(heap_task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+		~heap_task()
+		{
+			if (handle_)
+			{
+				handle_.destroy();
+			}
+		}
+
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+		{
+			handle_.promise().continuation_ = awaiting;
+			return handle_;
+		}
+		T await_resume() noexcept { return handle_.promise().value_; }
+
+		// Runs the task to completion on this thread, it never suspends elsewhere.
+		T run()
+		{
+			handle_.resume();
+			return handle_.promise().value_;
+		}
+
+	private:
+		std::coroutine_handle<promise_type> handle_;
+};
+
+static coro::Task<uint64_t> task_child(uint64_t i)
+{
+	co_return i;
+}
+
+static coro::Task<uint64_t> task_parent()
+{
+	uint64_t sum{0};
+	for (uint64_t i = 0; i < children; ++i)
+	{
+		sum += co_await task_child(i);
+	}
+	co_return sum;
+}
+
+static heap_task<uint64_t> heap_child(uint64_t i)
+{
+	co_return i;
+}
+
+static heap_task<uint64_t> heap_parent()
+{
+	uint64_t sum{0};
+	for (uint64_t i = 0; i < children; ++i)
+	{
+		sum += co_await heap_child(i);
+	}
+	co_return sum;
+}
+
+static void report(const char* name, std::size_t tasks, clock_type::time_point start)
+{
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+	std::cout << "  " << name << ": " << static_cast<double>(ns) / tasks << " ns/task\n";
+}
+
+static void print_metrics()
+{
+	const auto m = coro::detail::frame_allocator::metrics();
+	std::cout << "  frames: " << m.allocations << " allocated, " << m.deallocations << " freed, "
+		<< m.cache_hits << " cache hits, " << m.heap_allocations << " from malloc, "
+		<< m.remote_frees << " freed remotely, " << m.cached_bytes << " bytes cached\n";
+}
+
+template <typename Func>
+static void run_remote(const char* name, std::size_t batches, Func make)
+{
+	std::vector<decltype(make(0))> pending{};
+	pending.reserve(children * 100);
+
+	const auto start = clock_type::now();
+	for (std::size_t i = 0; i < batches; ++i)
+	{
+		for (std::size_t j = 0; j < children * 100; ++j)
+		{
+			pending.emplace_back(make(j));
+		}
+		std::thread{[&pending]() { pending.clear(); }}.join();
+	}
+	report(name, batches * children * 100, start);
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t requests = argc > 1 ? std::stoul(argv[1]) : 100000;
+	const std::size_t tasks = requests * (children + 1);
+	uint64_t checksum{0};
+
+	std::cout << requests << " requests of " << children + 1 << " tasks, free lists "
+#if defined(CORO_FRAME_ALLOCATOR)
+		<< "on\n";
+#else
+		<< "off\n";
+#endif
+
+	auto start = clock_type::now();
+	for (std::size_t i = 0; i < requests; ++i)
+	{
+		checksum += heap_parent().run();
+	}
+	report("heap_task ", tasks, start);
+
+	start = clock_type::now();
+	for (std::size_t i = 0; i < requests; ++i)
+	{
+		auto parent = task_parent();
+		parent.resume();
+		checksum += parent.promise().result();
+	}
+	report("coro::Task", tasks, start);
+	print_metrics();
+
+	// Frames created here and destroyed by another thread travel back
+	// through this thread's remote queue, the next batch reuses them.
+	const std::size_t batches = requests / 100;
+	run_remote("heap_task ", batches, heap_child);
+	run_remote("coro::Task", batches, task_child);
+	print_metrics();
+
+	std::cout << "checksum " << checksum << "\n";
+}
@@ -0,0 +1,257 @@
+#include <io_scheduler.h>
+#include <task.h>
+#include <sync_wait.h>
+#include <when_all.h>
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+static const char* to_string(coro::PollStatus status)
+{
+	switch (status)
+	{
+		case coro::PollStatus::EVENT: return "event";
+		case coro::PollStatus::TIMEOUT: return "timeout";
+		case coro::PollStatus::ERROR: return "error";
+		case coro::PollStatus::CLOSED: return "closed";
+		case coro::PollStatus::CANCELLED: return "cancelled";
+	}
+	return "unknown";
+}
+
+// Prints the non empty power of two buckets as "<upper bound>:count".
+template <std::size_t bucket_count>
+static void print_histogram(const char* name, const std::array<uint64_t, bucket_count>& histogram)
+{
+	std::cout << "  " << name << ":";
+	for (std::size_t i = 0; i < bucket_count; ++i)
+	{
+		if (histogram[i] != 0)
+		{
+			std::cout << " <" << (uint64_t{1} << i) << ":" << histogram[i];
+		}
+	}
+	std::cout << "\n";
+}
+
+static void run(coro::IOScheduler::Backend backend, std::size_t reactors = 1,
+		std::chrono::microseconds busy_poll = std::chrono::microseconds{0})
+{
+	coro::IOScheduler scheduler{coro::IOScheduler::options{
+		.pool = {.thread_count = 2},
+		.backend = backend,
+		.reactor_count = reactors,
+		.busy_poll = busy_poll}};
+
+	std::cout << "backend: "
+		<< (scheduler.backend() == coro::IOScheduler::Backend::IO_URING ? "io_uring" : "epoll")
+		<< ", reactors: " << scheduler.reactor_count() << "\n";
+
+	int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	auto reader = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		auto status = co_await scheduler.poll(efd, coro::PollOption::READ, 1000ms);
+		eventfd_t value{0};
+		eventfd_read(efd, &value);
+		std::cout << "reader: " << to_string(status) << " value = " << value << "\n";
+	};
+
+	auto writer = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		co_await scheduler.yield_for(20ms);
+		eventfd_write(efd, 42);
+		std::cout << "writer: wrote after 20ms\n";
+	};
+
+	auto timed_out = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		int never = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		auto status = co_await scheduler.poll(never, coro::PollOption::READ, 10ms);
+		close(never);
+		std::cout << "timed_out: " << to_string(status) << "\n";
+	};
+
+	auto registered = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		{
+			// Stays in the reactor between polls, removed when the handle goes away.
+			auto handle = scheduler.register_fd(fd, coro::PollOption::READ);
+			auto first = co_await scheduler.poll(handle, coro::PollOption::READ, 10ms);
+			eventfd_write(fd, 1);
+			auto second = co_await scheduler.poll(handle, coro::PollOption::READ, 10ms);
+			std::cout << "registered: " << to_string(first) << " then " << to_string(second) << "\n";
+		}
+		close(fd);
+	};
+
+	// Each sleeper's deadline is earlier than the last one's, the slack lets
+	// them share a timerfd expiry instead of moving it every time.
+	auto sleepers = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		std::vector<coro::Task<void>> tasks{};
+		for (int i = 0; i < 20; ++i)
+		{
+			tasks.emplace_back([&scheduler](std::chrono::milliseconds amount) -> coro::Task<void>
+				{
+					co_await scheduler.yield_for(amount, 8ms);
+				}(std::chrono::milliseconds{40 - i}));
+		}
+		co_await coro::when_all(std::move(tasks));
+		std::cout << "sleepers: done\n";
+	};
+
+	coro::sync_wait(sleepers());
+
+	// Stopping the source ends both waits long before their timeouts.
+	auto cancelled = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		int never = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		auto [polled, slept] = co_await coro::when_all(
+			scheduler.poll(never, coro::PollOption::READ, 10s), scheduler.yield_for(10s));
+		close(never);
+		std::cout << "cancelled: " << to_string(polled.return_value()) << " and "
+			<< to_string(slept.return_value()) << "\n";
+	};
+
+	std::stop_source stop{};
+	auto task = cancelled();
+	task.set_stop_token(stop.get_token());
+	std::thread stopper{[&stop]
+		{
+			std::this_thread::sleep_for(20ms);
+			stop.request_stop();
+		}};
+	coro::sync_wait(std::move(task));
+	stopper.join();
+	coro::sync_wait(coro::when_all(reader(), writer(), timed_out(), registered()));
+	close(efd);
+
+	for (const auto& r : scheduler.metrics().reactors)
+	{
+		std::cout << "reactor: " << r.wakeups << " wakeups, " << r.events << " events, "
+			<< r.busy_poll_wakeups << " while busy polling, "
+			<< r.timer_rearms << " timer rearms, " << r.timer_rearms_avoided << " avoided\n";
+		std::cout << "  " << r.loop_iterations << " iterations, "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(r.blocked_time).count() << "ms blocked, "
+			<< std::chrono::duration_cast<std::chrono::microseconds>(r.busy_time).count() << "us busy\n";
+		print_histogram("loop duration (us)", r.loop_duration);
+		print_histogram("timer lateness (us)", r.timer_lateness);
+		print_histogram("scheduled batch", r.scheduled_batch_size);
+		print_histogram("resume batch", r.resume_batch_size);
+	}
+}
+
+// Short continuations stay on the io thread, the long ones move to the pool.
+static void run_adaptive()
+{
+	coro::IOScheduler scheduler{coro::IOScheduler::options{
+		.pool = {.thread_count = 2},
+		.execution_strategy = coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_ADAPTIVE,
+		.inline_budget = std::chrono::microseconds{50}}};
+
+	auto worker = [](coro::IOScheduler& scheduler, std::chrono::microseconds work) -> coro::Task<void>
+	{
+		for (int i = 0; i < 50; ++i)
+		{
+			co_await scheduler.yield();
+			const auto until = std::chrono::steady_clock::now() + work;
+			while (std::chrono::steady_clock::now() < until)
+			{
+			}
+		}
+	};
+
+	coro::sync_wait(coro::when_all(worker(scheduler, std::chrono::microseconds{0}),
+		worker(scheduler, std::chrono::microseconds{500})));
+
+	for (const auto& r : scheduler.metrics().reactors)
+	{
+		std::cout << "adaptive: " << r.inline_resumes << " inline, " << r.offloaded_resumes << " offloaded, "
+			<< r.budget_overruns << " over budget\n";
+	}
+}
+
+// A MANUAL scheduler nested in an outer epoll loop, which only calls
+// process_events() when the scheduler's fd polls readable.
+static void run_nested(coro::IOScheduler::Backend backend)
+{
+	coro::IOScheduler scheduler{coro::IOScheduler::options{
+		.thread_strategy = coro::IOScheduler::ThreadStrategy::MANUAL,
+		.execution_strategy = coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_INLINE,
+		.backend = backend}};
+
+	int outer = epoll_create1(EPOLL_CLOEXEC);
+	epoll_event e{};
+	e.events = EPOLLIN;
+	epoll_ctl(outer, EPOLL_CTL_ADD, scheduler.poll_fd(), &e);
+
+	int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	bool done{false};
+
+	auto nested = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+		co_await scheduler.yield_for(20ms);
+		auto status = co_await scheduler.poll(efd, coro::PollOption::READ, 1000ms);
+		std::cout << "nested: " << to_string(status) << "\n";
+		done = true;
+	};
+	scheduler.schedule(nested());
+
+	std::thread writer{[efd]
+		{
+			std::this_thread::sleep_for(40ms);
+			eventfd_write(efd, 1);
+		}};
+
+	std::size_t waits{0};
+	while (!done)
+	{
+		// The timerfd wakes the outer loop anyway, the deadline just shows what is next.
+		int timeout{-1};
+		if (auto deadline = scheduler.next_deadline(); deadline.has_value())
+		{
+			timeout = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(
+				*deadline - std::chrono::steady_clock::now()).count()));
+		}
+
+		epoll_event ready{};
+		epoll_wait(outer, &ready, 1, timeout);
+		scheduler.process_events(0ms);
+		++waits;
+	}
+
+	writer.join();
+	close(efd);
+	close(outer);
+	std::cout << "nested: " << waits << " outer loop wakeups\n";
+}
+
+int main()
+{
+	run(coro::IOScheduler::Backend::EPOLL);
+	run(coro::IOScheduler::Backend::IO_URING);
+	run(coro::IOScheduler::Backend::EPOLL, 2);
+	run(coro::IOScheduler::Backend::EPOLL, 1, std::chrono::microseconds{200});
+	run_adaptive();
+	run_nested(coro::IOScheduler::Backend::EPOLL);
+	run_nested(coro::IOScheduler::Backend::IO_URING);
+}
@@ -0,0 +1,132 @@
+#include <io_scheduler.h>
+#include <sync_wait.h>
+#include <task.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Counts heap allocations made while coroutines wait on poll(), yield_for()
+// and a registered fd. The awaiters keep their state in the caller's frame,
+// so once the scheduler's buffers are warm every wait should allocate nothing.
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order::relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+static void report(const char* name, std::size_t n, std::size_t allocated, clock_type::time_point start)
+{
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+	std::cout << "  " << name << ": " << static_cast<double>(ns) / n << " ns/wait, "
+		<< static_cast<double>(allocated) / n << " allocations/wait\n";
+}
+
+template <typename Func>
+static coro::Task<void> measure(const char* name, std::size_t n, Func wait)
+{
+	// Warm up whatever the scheduler grows lazily.
+	for (std::size_t i = 0; i < 1000; ++i)
+	{
+		co_await wait();
+	}
+
+	const auto before = allocations.load(std::memory_order::relaxed);
+	const auto start = clock_type::now();
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		co_await wait();
+	}
+	report(name, n, allocations.load(std::memory_order::relaxed) - before, start);
+}
+
+static void run(coro::IOScheduler::Backend backend, coro::IOScheduler::ExecutionStrategy strategy, std::size_t n)
+{
+	coro::IOScheduler scheduler{coro::IOScheduler::options{
+		.pool = {.thread_count = 1},
+		.execution_strategy = strategy,
+		.backend = backend}};
+
+	std::cout << (scheduler.backend() == coro::IOScheduler::Backend::IO_URING ? "io_uring" : "epoll")
+		<< (strategy == coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_INLINE ? ", inline" : ", thread pool")
+		<< "\n";
+
+	// The counter is never read back, the eventfd stays readable.
+	int efd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+	int registered_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	auto handle = scheduler.register_fd(registered_efd, coro::PollOption::READ);
+
+	auto make_task = [&]() -> coro::Task<void>
+	{
+		co_await scheduler.schedule();
+
+		co_await measure("poll         ", n, [&]
+				{
+					return scheduler.poll(efd, coro::PollOption::READ, 1000ms);
+				});
+
+		co_await measure("registered fd", n, [&]
+				{
+					// Every write is a new edge, often cached before the poll.
+					uint64_t value{1};
+					auto written = ::write(registered_efd, &value, sizeof(value));
+					(void)written;
+					return scheduler.poll(handle, coro::PollOption::READ, 1000ms);
+				});
+
+		co_await measure("yield_for(0) ", n, [&]
+				{
+					return scheduler.yield_for(0ms);
+				});
+
+		co_await measure("yield_for(1) ", 200, [&]
+				{
+					return scheduler.yield_for(1ms);
+				});
+	};
+
+	coro::sync_wait(make_task());
+
+	handle = {};
+	close(registered_efd);
+	close(efd);
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t n = argc > 1 ? std::stoul(argv[1]) : 100000;
+
+	for (auto backend : {coro::IOScheduler::Backend::EPOLL, coro::IOScheduler::Backend::IO_URING})
+	{
+		for (auto strategy : {coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_INLINE,
+				coro::IOScheduler::ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL})
+		{
+			run(backend, strategy, n);
+		}
+	}
+}
@@ -1,7 +1,18 @@
 #include <task.h>
 #include <sync_wait.h>
 
+#include <array>
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+
+// Frames of tasks called with std::allocator_arg come from the given allocator.
+static coro::Task<uint64_t> arena_square(std::allocator_arg_t, std::pmr::polymorphic_allocator<> alloc, uint64_t x)
+{
+	(void)alloc;
+	co_return x * x;
+}
 
 int main()
 {
@@ -20,4 +31,23 @@ int main()
 
 	auto output = coro::sync_wait(square_and_add_5(5));
 	std::cout << "Task1 output: " << output << "\n";
+
+	// One arena per request, released at once when the request is done. The
+	// null upstream resource throws should a frame not fit.
+	std::array<std::byte, 4096> buffer{};
+	std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size(), std::pmr::null_memory_resource()};
+	std::pmr::polymorphic_allocator<> alloc{&arena};
+
+	auto request = 
+		[](std::allocator_arg_t, std::pmr::polymorphic_allocator<> alloc, uint64_t input) -> coro::Task<uint64_t>
+		{
+			auto squared = co_await arena_square(std::allocator_arg, alloc, input);
+			co_return squared + 5;
+		};
+
+	const auto before = coro::detail::frame_allocator::metrics().allocations;
+	output = coro::sync_wait(request(std::allocator_arg, alloc, 6));
+	std::cout << "Task2 output: " << output << ", frames outside the arena: "
+		<< coro::detail::frame_allocator::metrics().allocations - before << "\n";
+	arena.release();
 }
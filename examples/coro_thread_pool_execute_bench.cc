@@ -0,0 +1,60 @@
+#include <thread_pool.h>
+#include <task.h>
+#include <sync_wait.h>
+#include <when_all.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Submits many tiny closures through the coroutine schedule(f) path and
+// through execute(f) and reports the throughput of both.
+int main(int argc, char** argv)
+{
+	const std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+	coro::ThreadPool thread_pool{coro::ThreadPool::options{.thread_count = 4}};
+	std::atomic<uint64_t> counter{0};
+
+	auto report = [&](const char* name, auto start)
+	{
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		std::cout << name << ": " << iterations << " closures in " << ns / 1000000 << " ms, "
+			<< static_cast<double>(ns) / iterations << " ns/op, counter = " << counter.load() << "\n";
+	};
+
+	{
+		auto work = [&]() { counter.fetch_add(1, std::memory_order::relaxed); };
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<coro::Task<void>> tasks{};
+		tasks.reserve(iterations);
+		for (std::size_t i = 0; i < iterations; ++i)
+		{
+			tasks.emplace_back(thread_pool.schedule(work));
+		}
+		coro::sync_wait(coro::when_all(std::move(tasks)));
+		report("schedule(f)", start);
+	}
+
+	counter = 0;
+
+	{
+		coro::Event done{};
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < iterations; ++i)
+		{
+			thread_pool.execute([&]()
+					{
+						if (counter.fetch_add(1, std::memory_order::relaxed) + 1 == iterations)
+						{
+							done.set();
+						}
+					});
+		}
+		coro::sync_wait(done);
+		report("execute(f)", start);
+	}
+}
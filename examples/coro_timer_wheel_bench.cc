@@ -0,0 +1,119 @@
+#include <detail/timer_wheel.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Arms n timers, cancels every other one and expires the rest in 1ms steps,
+// once with the std::multimap the IOScheduler used to keep and once with
+// detail::timer_wheel.
+using clock_type = std::chrono::steady_clock;
+
+struct timer : coro::detail::timer_entry
+{
+	std::multimap<clock_type::time_point, timer*>::iterator pos_;
+	clock_type::time_point deadline_;
+};
+
+static void report(const char* name, const char* phase, std::size_t n, clock_type::time_point start)
+{
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+	std::cout << "  " << name << " " << phase << ": " << ns / 1000000 << " ms, "
+		<< static_cast<double>(ns) / n << " ns/timer\n";
+}
+
+static void run_multimap(std::vector<timer>& timers, clock_type::time_point origin, std::chrono::milliseconds span)
+{
+	std::multimap<clock_type::time_point, timer*> events{};
+	const std::size_t n = timers.size();
+
+	auto start = clock_type::now();
+	for (auto& t : timers)
+	{
+		t.pos_ = events.emplace(t.deadline_, &t);
+	}
+	report("multimap", "insert", n, start);
+
+	start = clock_type::now();
+	for (std::size_t i = 0; i < n; i += 2)
+	{
+		events.erase(timers[i].pos_);
+	}
+	report("multimap", "cancel", n / 2, start);
+
+	start = clock_type::now();
+	std::size_t expired{0};
+	for (auto now = origin; now <= origin + span; now += std::chrono::milliseconds{1})
+	{
+		while (!events.empty() && events.begin()->first <= now)
+		{
+			events.erase(events.begin());
+			++expired;
+		}
+	}
+	report("multimap", "expire", expired, start);
+}
+
+static void run_wheel(std::vector<timer>& timers, clock_type::time_point origin, std::chrono::milliseconds span)
+{
+	auto wheel = std::make_unique<coro::detail::timer_wheel>(origin);
+	const std::size_t n = timers.size();
+
+	auto start = clock_type::now();
+	for (auto& t : timers)
+	{
+		wheel->insert(t, t.deadline_);
+	}
+	report("wheel   ", "insert", n, start);
+
+	start = clock_type::now();
+	for (std::size_t i = 0; i < n; i += 2)
+	{
+		wheel->remove(timers[i]);
+	}
+	report("wheel   ", "cancel", n / 2, start);
+
+	start = clock_type::now();
+	std::size_t expired{0};
+	for (auto now = origin; now <= origin + span; now += std::chrono::milliseconds{1})
+	{
+		expired += wheel->expire(now, [](coro::detail::timer_entry&) {});
+	}
+	report("wheel   ", "expire", expired, start);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::size_t> sizes{10000, 1000000, 10000000};
+	if (argc > 1)
+	{
+		sizes.clear();
+		for (int i = 1; i < argc; ++i)
+		{
+			sizes.emplace_back(std::stoul(argv[i]));
+		}
+	}
+
+	// Deadlines are spread over a minute, like connection and request timeouts.
+	const std::chrono::milliseconds span{60000};
+	const auto origin = clock_type::now();
+	std::mt19937_64 rng{42};
+
+	for (auto n : sizes)
+	{
+		std::vector<timer> timers(n);
+		for (auto& t : timers)
+		{
+			t.deadline_ = origin + std::chrono::microseconds{rng() % (span.count() * 1000)};
+		}
+
+		std::cout << n << " timers\n";
+		run_multimap(timers, origin, span);
+		run_wheel(timers, origin, span);
+	}
+}
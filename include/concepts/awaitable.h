@@ -34,8 +34,9 @@ concept awaiter = requires(type t, std::coroutine_handle<> co)
     { t.await_resume() };
 };
 
+// Awaiters are awaitable themselves, co_await uses them as they are.
 template <typename type>
-concept awaitable = requires(type t)
+concept awaitable = awaiter<type> || requires(type t)
 {
     { t.operator co_await() } ->awaiter;
 };
@@ -63,9 +64,16 @@ struct awaitable_traits
 };
 
 template <awaitable awaitable>
-static auto get_awaiter(awaitable&& value)
+static auto get_awaiter(awaitable&& value) -> decltype(auto)
 {
-    return std::forward<awaitable>(value).operator co_await();
+    if constexpr (awaiter<awaitable>)
+    {
+        return std::forward<awaitable>(value);
+    }
+    else
+    {
+        return std::forward<awaitable>(value).operator co_await();
+    }
 }
 
 template <awaitable awaitable>
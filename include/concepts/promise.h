@@ -3,6 +3,7 @@
 #include <concepts/awaitable.h>
 
 #include <concepts>
+#include <stop_token>
 
 namespace coro::concepts
 {
@@ -20,4 +21,11 @@ concept promise = requires(type t)
         || std::same_as<decltype(t.return_value(return_value)), void>
         || requires { t.yield_value(return_value); };
 };
+
+// Promises whose coroutine can be asked to stop, awaitables read the token from them.
+template <typename type>
+concept stoppable_promise = requires(const type& t)
+{
+    { t.get_stop_token() } -> std::same_as<std::stop_token>;
+};
 } // namespace coro::concepts
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace coro::detail
+{
+struct cpu_topology
+{
+    struct node
+    {
+        uint32_t id;
+        std::vector<uint32_t> cpus;
+    };
+
+    // NUMA nodes in ascending id order, only CPUs this process may run on.
+    std::vector<node> nodes{};
+
+    /*
+     * Reads /sys/devices/system/node. Machines or containers without that
+     * information are reported as a single node 0 holding every allowed CPU.
+     */
+    static cpu_topology discover();
+
+    // Parses the kernel cpulist format, e.g. "0-3,8,10-11".
+    static std::vector<uint32_t> parse_cpu_list(std::string_view list);
+
+    // Index into nodes of the node owning cpu, or -1 when unknown.
+    int32_t node_of(uint32_t cpu) const noexcept;
+};
+
+// Restricts the calling thread to a single cpu, returns false if the kernel refused.
+bool pin_current_thread(uint32_t cpu) noexcept;
+
+} // namespace coro::detail
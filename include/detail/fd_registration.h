@@ -0,0 +1,44 @@
+#pragma once
+
+#include <detail/poll_info.h>
+#include <fd.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace coro::detail
+{
+/*
+ * State of an fd that stays registered with a reactor between polls. The
+ * kernel reports edges, the readiness they carry is cached in ready_ until a
+ * poll() consumes it, so a poll on an fd already known to be ready completes
+ * without a syscall.
+ */
+struct fd_registration
+{
+    fd_registration() = default;
+    ~fd_registration() = default;
+
+    fd_registration(const fd_registration&) = delete;
+    fd_registration(fd_registration&&) = delete;
+    fd_registration& operator=(const fd_registration&) = delete;
+    fd_registration& operator=(fd_registration&&) = delete;
+
+    fd_t fd_{-1};
+    // EPOLLIN and/or EPOLLOUT, the directions the kernel reports.
+    uint32_t interest_{0};
+    // Epoll bits seen and not yet consumed, hangups and errors stay set.
+    std::atomic<uint32_t> ready_{0};
+    // The poll() waiting in each direction, at most one each.
+    std::atomic<poll_info*> reader_{nullptr};
+    std::atomic<poll_info*> writer_{nullptr};
+    // Set once the handle is gone, the reactor frees it when released_ is set
+    // too, which is when the kernel no longer reports events for it.
+    bool retired_{false};
+    bool released_{false};
+    // Set when the kernel ended an io_uring poll with an error, it is not
+    // re-armed and nothing is left to remove.
+    bool failed_{false};
+};
+
+} // namespace coro::detail
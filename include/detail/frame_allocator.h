@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace coro::detail
+{
+
+/*
+ * Allocator behind Task coroutine frames. Frames are rounded up to 64 byte
+ * size classes and recycled through per thread free lists, so creating a
+ * task usually pops a list instead of calling malloc. A frame freed on a
+ * thread other than the one that allocated it is pushed to its owner's
+ * lock-free remote queue, which the owner drains once a list runs dry.
+ *
+ * Each frame carries a 16 byte header naming its owner and size class.
+ * Frames above the largest class go straight to global operator new. Frames of a
+ * coroutine called with std::allocator_arg come from that allocator instead,
+ * a copy of it is kept in front of the header to free them again.
+ *
+ * The free lists are opt-in, the library is built with CORO_FRAME_ALLOCATOR
+ * to use them. Otherwise Task frames come from allocate_unpooled(), global
+ * operator new behind the same header, and are left out of the metrics.
+ */
+class frame_allocator
+{
+    public:
+        static constexpr std::size_t class_granularity{64};
+        static constexpr std::size_t class_count{32};
+        static constexpr std::size_t max_class_size{class_granularity * class_count};
+        // Bytes a thread keeps per size class from its own frees, anything beyond is freed.
+        static constexpr std::size_t max_cached_bytes{64 * 1024};
+
+        struct metrics_snapshot
+        {
+            uint64_t allocations;
+            uint64_t deallocations;
+            // Allocations served from a free list, and the ones that fell through to malloc.
+            uint64_t cache_hits;
+            uint64_t heap_allocations;
+            // Allocations larger than max_class_size.
+            uint64_t oversized;
+            // Frames freed on another thread than the one that allocated them.
+            uint64_t remote_frees;
+            // Bytes held in free lists, remote queues not drained yet excluded.
+            uint64_t cached_bytes;
+            std::array<uint64_t, class_count> allocations_per_class;
+        };
+
+        struct alignas(16) frame_header
+        {
+            // The thread_cache a frame belongs to, nullptr when it bypasses them.
+            void* owner_;
+            // The size class, or for frames from a user allocator the function
+            // that frees them, 0 for frames straight from operator new.
+            uintptr_t info_;
+        };
+
+        static void* allocate(std::size_t size);
+
+        // Allocates from global operator new, bypassing the free lists and counters.
+        static void* allocate_unpooled(std::size_t size);
+
+        // Allocates from alloc, rebound to 16 byte aligned chunks.
+        template <typename Alloc>
+        static void* allocate(std::size_t size, const Alloc& alloc)
+        {
+            using chunk_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<frame_chunk>;
+            static_assert(alignof(chunk_alloc) <= alignof(frame_header), "the stored allocator must not shift the frame");
+
+            chunk_alloc chunks{alloc};
+            auto* base = reinterpret_cast<std::byte*>(
+                std::allocator_traits<chunk_alloc>::allocate(chunks, chunk_count<chunk_alloc>(size)));
+            ::new (base) chunk_alloc{std::move(chunks)};
+
+            auto* header = ::new (base + stored_size<chunk_alloc>()) frame_header{
+                .owner_ = nullptr,
+                .info_ = reinterpret_cast<uintptr_t>(&release<chunk_alloc>)};
+            return header + 1;
+        }
+
+        // size is the one the frame was allocated with.
+        static void deallocate(void* ptr, std::size_t size) noexcept;
+
+        // Sums the counters of every thread that ever allocated a frame.
+        static metrics_snapshot metrics();
+
+    private:
+        struct alignas(16) frame_chunk
+        {
+            std::byte bytes_[16];
+        };
+
+        template <typename chunk_alloc>
+        static constexpr std::size_t stored_size() noexcept
+        {
+            return (sizeof(chunk_alloc) + sizeof(frame_chunk) - 1) / sizeof(frame_chunk) * sizeof(frame_chunk);
+        }
+
+        template <typename chunk_alloc>
+        static constexpr std::size_t chunk_count(std::size_t size) noexcept
+        {
+            return (stored_size<chunk_alloc>() + sizeof(frame_header) + size + sizeof(frame_chunk) - 1) / sizeof(frame_chunk);
+        }
+
+        template <typename chunk_alloc>
+        static void release(frame_header* header, std::size_t size) noexcept
+        {
+            auto* base = reinterpret_cast<std::byte*>(header) - stored_size<chunk_alloc>();
+            auto* stored = std::launder(reinterpret_cast<chunk_alloc*>(base));
+            chunk_alloc chunks{std::move(*stored)};
+            stored->~chunk_alloc();
+            std::allocator_traits<chunk_alloc>::deallocate(
+                chunks, reinterpret_cast<frame_chunk*>(base), chunk_count<chunk_alloc>(size));
+        }
+};
+
+} // namespace coro::detail
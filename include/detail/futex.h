@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace coro::detail
+{
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32 bit integers");
+
+/*
+ * Blocks the calling thread while word == expected. Returns on a wake, a
+ * signal, a timeout or immediately if the word already changed, callers are
+ * expected to re-check their own condition in a loop.
+ */
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, const timespec* timeout = nullptr) noexcept
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word, int count = 1) noexcept
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+} // namespace coro::detail
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <fd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+
+#include <linux/io_uring.h>
+
+namespace coro::detail
+{
+
+/*
+ * Minimal io_uring instance driven through the raw syscalls. The submission
+ * side is single producer, callers serialise get_sqe(), publish() and
+ * submit() between themselves. Completions are reaped by one thread only,
+ * which may block in wait() while another thread submits.
+ */
+class io_uring
+{
+    public:
+        /*
+         * Returns nullptr when the kernel does not provide io_uring, it is
+         * disabled, or it lacks the features the scheduler relies on.
+         */
+        static std::unique_ptr<io_uring> create(uint32_t entries) noexcept;
+
+        io_uring(const io_uring&) = delete;
+        io_uring(io_uring&&) = delete;
+        io_uring& operator=(const io_uring&) = delete;
+        io_uring& operator=(io_uring&&) = delete;
+        ~io_uring();
+
+        // Next free submission entry, zeroed, or nullptr when the ring is full.
+        io_uring_sqe* get_sqe() noexcept;
+
+        // Makes every prepared entry visible to the kernel, returns how many it has not taken yet.
+        uint32_t publish() noexcept;
+
+        // Hands every prepared entry to the kernel, returns how many it took or -errno.
+        int submit() noexcept;
+
+        /*
+         * Blocks until at least one completion is ready or timeout (nullptr
+         * waits forever) expires. The same enter submits to_submit published
+         * entries first.
+         */
+        void wait(const timespec* timeout, uint32_t to_submit = 0) noexcept;
+
+        // IORING_POLL_ADD_MULTI is available (5.13).
+        bool multishot_poll() const noexcept
+        {
+            return multishot_poll_;
+        }
+
+        // Completions waiting to be reaped, never enters the kernel.
+        std::size_t ready() const noexcept
+        {
+            return cq_tail_->load(std::memory_order::acquire) - cq_head_->load(std::memory_order::relaxed);
+        }
+
+        // Calls f(const io_uring_cqe&) for up to max ready completions and consumes them.
+        template <typename Func>
+        std::size_t reap(Func&& f, std::size_t max = SIZE_MAX)
+        {
+            uint32_t head = cq_head_->load(std::memory_order::relaxed);
+            const uint32_t tail = cq_tail_->load(std::memory_order::acquire);
+            std::size_t count{0};
+            for (; head != tail && count < max; ++head, ++count)
+            {
+                f(cqes_[head & cq_mask_]);
+            }
+            cq_head_->store(head, std::memory_order::release);
+            return count;
+        }
+
+        fd_t fd() const noexcept
+        {
+            return ring_fd_;
+        }
+
+    private:
+        io_uring() = default;
+
+        fd_t ring_fd_{-1};
+
+        void* ring_ptr_{nullptr};
+        std::size_t ring_size_{0};
+        io_uring_sqe* sqes_{nullptr};
+        std::size_t sqes_size_{0};
+
+        std::atomic<uint32_t>* sq_head_{nullptr};
+        std::atomic<uint32_t>* sq_tail_{nullptr};
+        uint32_t sq_mask_{0};
+        uint32_t sq_entries_{0};
+        // Entries handed out by get_sqe(), the kernel consumes them up to sq_head_.
+        uint32_t sqe_tail_{0};
+        bool multishot_poll_{false};
+
+        std::atomic<uint32_t>* cq_head_{nullptr};
+        std::atomic<uint32_t>* cq_tail_{nullptr};
+        uint32_t cq_mask_{0};
+        io_uring_cqe* cqes_{nullptr};
+};
+
+} // namespace coro::detail
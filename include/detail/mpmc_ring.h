@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+namespace coro::detail
+{
+
+/*
+ * Bounded lock-free multi producer, multi consumer ring (Vyukov). Every cell
+ * carries a sequence number telling producers and consumers whose turn it is,
+ * so a push or pop costs one CAS on the shared position and no allocation.
+ *
+ * Producers may also reserve a run of cells with a single CAS through
+ * try_reserve() and fill them with publish(). Consumers that claimed a cell
+ * release it right after copying the value out, a reserving producer waits for
+ * that to happen before overwriting the cell.
+ */
+template <typename T>
+class mpmc_ring
+{
+    static_assert(std::is_trivially_copyable_v<T>, "mpmc_ring items must be trivially copyable");
+
+    struct cell
+    {
+        std::atomic<uint64_t> sequence_;
+        T value_;
+    };
+
+    public:
+        explicit mpmc_ring(std::size_t capacity = 1024)
+            : capacity_(round_up_pow2(capacity))
+            , mask_(capacity_ - 1)
+            , cells_(std::make_unique<cell[]>(capacity_))
+        {
+            for (uint64_t i = 0; i < capacity_; ++i)
+            {
+                cells_[i].sequence_.store(i, std::memory_order::relaxed);
+            }
+        }
+
+        mpmc_ring(const mpmc_ring&) = delete;
+        mpmc_ring(mpmc_ring&&) = delete;
+        mpmc_ring& operator=(const mpmc_ring&) = delete;
+        mpmc_ring& operator=(mpmc_ring&&) = delete;
+        ~mpmc_ring() = default;
+
+        bool try_push(T value) noexcept
+        {
+            uint64_t pos = enqueue_pos_.load(std::memory_order::relaxed);
+            cell* c{nullptr};
+            while (true)
+            {
+                c = &cells_[pos & mask_];
+                const uint64_t seq = c->sequence_.load(std::memory_order::acquire);
+                const auto dif = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+                if (dif == 0)
+                {
+                    if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = enqueue_pos_.load(std::memory_order::relaxed);
+                }
+            }
+
+            c->value_ = value;
+            c->sequence_.store(pos + 1, std::memory_order::release);
+            return true;
+        }
+
+        /*
+         * Reserves up to n consecutive cells with one CAS. Returns how many
+         * were reserved, first receives the position to hand to publish().
+         * Every reserved position must be published.
+         */
+        std::size_t try_reserve(std::size_t n, uint64_t& first) noexcept
+        {
+            uint64_t pos = enqueue_pos_.load(std::memory_order::relaxed);
+            while (true)
+            {
+                const uint64_t d = dequeue_pos_.load(std::memory_order::acquire);
+                if (d > pos)
+                {
+                    pos = enqueue_pos_.load(std::memory_order::relaxed);
+                    continue;
+                }
+
+                const uint64_t used = pos - d;
+                const uint64_t free = used >= capacity_ ? 0 : capacity_ - used;
+                const uint64_t k = std::min<uint64_t>(n, free);
+                if (k == 0)
+                {
+                    return 0;
+                }
+
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + k, std::memory_order::relaxed))
+                {
+                    first = pos;
+                    return k;
+                }
+            }
+        }
+
+        void publish(uint64_t pos, T value) noexcept
+        {
+            cell& c = cells_[pos & mask_];
+            // The consumer of the previous lap may still be copying out.
+            for (uint32_t spins = 0; c.sequence_.load(std::memory_order::acquire) != pos; ++spins)
+            {
+                if (spins > 64)
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            c.value_ = value;
+            c.sequence_.store(pos + 1, std::memory_order::release);
+        }
+
+        std::optional<T> try_pop() noexcept
+        {
+            uint64_t pos = dequeue_pos_.load(std::memory_order::relaxed);
+            cell* c{nullptr};
+            while (true)
+            {
+                c = &cells_[pos & mask_];
+                const uint64_t seq = c->sequence_.load(std::memory_order::acquire);
+                const auto dif = static_cast<int64_t>(seq) - static_cast<int64_t>(pos + 1);
+                if (dif == 0)
+                {
+                    if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (dif < 0)
+                {
+                    return std::nullopt;
+                }
+                else
+                {
+                    pos = dequeue_pos_.load(std::memory_order::relaxed);
+                }
+            }
+
+            T value = c->value_;
+            c->sequence_.store(pos + capacity_, std::memory_order::release);
+            return value;
+        }
+
+        // Approximate, includes reserved but not yet published cells.
+        std::size_t size() const noexcept
+        {
+            const uint64_t d = dequeue_pos_.load(std::memory_order::acquire);
+            const uint64_t e = enqueue_pos_.load(std::memory_order::acquire);
+            return e > d ? static_cast<std::size_t>(e - d) : 0;
+        }
+
+        bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+        std::size_t capacity() const noexcept
+        {
+            return capacity_;
+        }
+
+    private:
+        const uint64_t capacity_;
+        const uint64_t mask_;
+        std::unique_ptr<cell[]> cells_;
+        alignas(64) std::atomic<uint64_t> enqueue_pos_{0};
+        alignas(64) std::atomic<uint64_t> dequeue_pos_{0};
+
+        static uint64_t round_up_pow2(std::size_t n) noexcept
+        {
+            uint64_t capacity = 2;
+            while (capacity < n)
+            {
+                capacity <<= 1;
+            }
+            return capacity;
+        }
+};
+
+} // namespace coro::detail
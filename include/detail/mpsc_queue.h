@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+
+namespace coro::detail
+{
+
+/*
+ * Intrusive lock-free multi producer, single consumer queue. Producers link
+ * their own node in with one CAS, the consumer takes everything queued so far
+ * with one exchange. Nodes need a node_type* next_ member and must stay alive
+ * until the consumer has taken them.
+ */
+template <typename node_type>
+class mpsc_queue
+{
+    public:
+        mpsc_queue() = default;
+        mpsc_queue(const mpsc_queue&) = delete;
+        mpsc_queue(mpsc_queue&&) = delete;
+        mpsc_queue& operator=(const mpsc_queue&) = delete;
+        mpsc_queue& operator=(mpsc_queue&&) = delete;
+        ~mpsc_queue() = default;
+
+        void push(node_type& node) noexcept
+        {
+            node_type* head = head_.load(std::memory_order::relaxed);
+            do
+            {
+                node.next_ = head;
+            }
+            while (!head_.compare_exchange_weak(head, &node, std::memory_order::seq_cst, std::memory_order::relaxed));
+        }
+
+        // Everything pushed so far, oldest first.
+        node_type* take_all() noexcept
+        {
+            node_type* head = head_.exchange(nullptr, std::memory_order::seq_cst);
+
+            // Pushes link newest first, reverse so nodes come out in order.
+            node_type* reversed{nullptr};
+            while (head != nullptr)
+            {
+                node_type* next = head->next_;
+                head->next_ = reversed;
+                reversed = head;
+                head = next;
+            }
+            return reversed;
+        }
+
+        bool empty() const noexcept
+        {
+            return head_.load(std::memory_order::acquire) == nullptr;
+        }
+
+    private:
+        alignas(64) std::atomic<node_type*> head_{nullptr};
+};
+
+} // namespace coro::detail
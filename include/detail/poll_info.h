@@ -1,21 +1,22 @@
 #pragma once
 
+#include <detail/timer_wheel.h>
 #include <fd.h>
 #include <poll.h>
 
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <coroutine>
-#include <map>
-#include <optional>
 
 namespace coro::detail
 {
-struct poll_info
+// The timer hook lives in the awaiting coroutine's frame, arming a timeout
+// never allocates.
+struct poll_info : timer_entry
 {
-    using clock = std::chrono::steady_clock;
-    using time_point = clock::time_point;
-    using timed_events = std::multimap<time_point, detail::poll_info*>;
+    using clock = timer_wheel::clock;
+    using time_point = timer_wheel::time_point;
 
     poll_info() = default;
     ~poll_info() = default;
@@ -25,42 +26,35 @@ struct poll_info
     poll_info& operator=(const poll_info&) = delete;
     poll_info& operator=(poll_info&&) = delete;
 
-    struct poll_awaiter
-    {
-        explicit poll_awaiter(poll_info& pi) noexcept
-            : pi_(pi)
-        {
-        
-        }
-
-        bool await_ready() const noexcept
-        {
-            return false;
-        }
-
-        void awaita_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
-        {
-            pi_.awaiting_coroutine_ = awaiting_coroutine;
-            std::atomic_thread_fence(std::memory_order::release);
-        }
-
-        poll_status await_resume() noexcept
-        {
-            pi_.poll_status_;
-        }
-
-        poll_info& pi_;
-    };
-
-    poll_awaiter operator co_await()
-    {
-        return poll_awaiter{*this};
-    }
-
     fd_t fd_{-1};
-    std::optional<timed_events::iterator> timer_pos_{std::nullopt};
     std::coroutine_handle<> awaiting_coroutine_;
-    coro::poll_status poll_status_{coro::poll_status::error};
+    /*
+     * The awaiter arms the timer, the fd and the stop callback before it
+     * suspends, any of them may trigger before the rest is in place. The io
+     * thread waits for publish_done before touching the poll_info, the
+     * awaiter only wakes it when it found publish_waiting.
+     */
+    static constexpr uint32_t publish_pending{0};
+    static constexpr uint32_t publish_waiting{1};
+    static constexpr uint32_t publish_done{2};
+    std::atomic<uint32_t> published_{publish_pending};
+    PollStatus poll_status_{PollStatus::ERROR};
     bool processed_{false};
+    // The io_uring backend cancels asynchronously, the coroutine is only
+    // resumed once the kernel no longer references this poll_info.
+    bool armed_{false};
+    // Set while waiting on a registered fd, the reader_ or writer_ slot of
+    // its fd_registration that holds this poll_info.
+    std::atomic<poll_info*>* slot_{nullptr};
+
+    // Set when the wait has a stop_callback. Whichever of the io thread and
+    // the callback moves cancel_state_ away from cancel_none first decides
+    // who resumes, deferred_ marks a resume left to the cancel request.
+    static constexpr uint8_t cancel_none{0};
+    static constexpr uint8_t cancel_queued{1};
+    static constexpr uint8_t cancel_done{2};
+    bool stoppable_{false};
+    bool deferred_{false};
+    std::atomic<uint8_t> cancel_state_{cancel_none};
 };
 } // namespace coro::detail
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <concepts/promise.h>
+
+#include <coroutine>
+#include <stop_token>
+
+namespace coro::detail
+{
+// The stop_token of the coroutine behind handle, an empty one when its
+// promise does not carry any.
+template <typename promise_type>
+std::stop_token stop_token_of(std::coroutine_handle<promise_type> handle) noexcept
+{
+    if constexpr (concepts::stoppable_promise<promise_type>)
+    {
+        return handle.promise().get_stop_token();
+    }
+    else
+    {
+        return std::stop_token{};
+    }
+}
+
+} // namespace coro::detail
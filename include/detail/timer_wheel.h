@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace coro::detail
+{
+
+/*
+ * Intrusive hook for timer_wheel, embedded in whatever waits on the timer so
+ * arming one never allocates.
+ */
+struct timer_entry
+{
+    timer_entry* prev_{nullptr};
+    timer_entry* next_{nullptr};
+    // Deadline in wheel ticks.
+    uint64_t deadline_{0};
+    // level * 64 + slot of the list holding this entry, due_list when already due.
+    uint32_t bucket_{0};
+    bool linked_{false};
+};
+
+/*
+ * Hierarchical timing wheel with 1ms ticks. Six levels of 64 slots cover
+ * 64^6 ms (about 2 years), anything further out waits in the last level and
+ * is cascaded down as time passes. Insert and cancel are O(1), finding the
+ * next deadline scans at most one 64 bit occupancy mask per level.
+ *
+ * Deadlines are rounded up to the next tick so a timer never fires early.
+ * Not thread safe, the owner provides locking.
+ */
+class timer_wheel
+{
+    public:
+        using clock = std::chrono::steady_clock;
+        using time_point = clock::time_point;
+        using tick_duration = std::chrono::milliseconds;
+
+        static constexpr std::size_t level_bits{6};
+        static constexpr std::size_t slots_per_level{std::size_t{1} << level_bits};
+        static constexpr std::size_t level_count{6};
+        static constexpr uint32_t due_list{level_count * slots_per_level};
+
+        explicit timer_wheel(time_point origin = clock::now()) noexcept
+            : origin_(origin)
+        {
+
+        }
+
+        timer_wheel(const timer_wheel&) = delete;
+        timer_wheel(timer_wheel&&) = delete;
+        timer_wheel& operator=(const timer_wheel&) = delete;
+        timer_wheel& operator=(timer_wheel&&) = delete;
+        ~timer_wheel() = default;
+
+        void insert(timer_entry& entry, time_point deadline) noexcept
+        {
+            entry.deadline_ = to_tick_ceil(deadline);
+            place(entry);
+            ++size_;
+        }
+
+        void remove(timer_entry& entry) noexcept
+        {
+            if (!entry.linked_)
+            {
+                return;
+            }
+
+            unlink(entry);
+            --size_;
+        }
+
+        /*
+         * Calls f(timer_entry&) for every timer due at now, each one is
+         * unlinked before f sees it.
+         */
+        template <typename Func>
+        std::size_t expire(time_point now, Func&& f)
+        {
+            const uint64_t now_tick = to_tick_floor(now);
+            std::size_t expired{0};
+
+            while (true)
+            {
+                expired += drain(due_, f);
+
+                auto next = next_expiration();
+                if (!next.has_value() || next->deadline_ > now_tick)
+                {
+                    break;
+                }
+
+                elapsed_ = next->deadline_;
+
+                // Every entry of a level 0 slot is due on its tick.
+                if (next->level_ == 0)
+                {
+                    expired += drain(levels_[0].slots_[next->slot_], f);
+                    levels_[0].occupied_ &= ~(uint64_t{1} << next->slot_);
+                    continue;
+                }
+
+                // Entries of a higher level slot span many ticks, the ones not
+                // due yet are cascaded into lower levels.
+                timer_entry* list = take_slot(next->level_, next->slot_);
+                while (list != nullptr)
+                {
+                    timer_entry* entry = list;
+                    list = entry->next_;
+                    place(*entry);
+                }
+            }
+
+            elapsed_ = std::max(elapsed_, now_tick);
+            return expired;
+        }
+
+        // Earliest pending deadline, or nullopt when no timer is armed.
+        std::optional<time_point> next_deadline() const noexcept
+        {
+            if (due_ != nullptr)
+            {
+                return to_time_point(elapsed_);
+            }
+
+            auto next = next_expiration();
+            if (!next.has_value())
+            {
+                return std::nullopt;
+            }
+            return to_time_point(next->deadline_);
+        }
+
+        // The tick entry was filed for, expire() returns it once that has passed.
+        time_point deadline(const timer_entry& entry) const noexcept
+        {
+            return to_time_point(entry.deadline_);
+        }
+
+        // When expire() first returns a timer with this deadline.
+        time_point due_time(time_point deadline) const noexcept
+        {
+            return to_time_point(to_tick_ceil(deadline));
+        }
+
+        std::size_t size() const noexcept
+        {
+            return size_;
+        }
+
+        bool empty() const noexcept
+        {
+            return size_ == 0;
+        }
+
+    private:
+        struct expiration
+        {
+            std::size_t level_;
+            std::size_t slot_;
+            uint64_t deadline_;
+        };
+
+        struct level
+        {
+            uint64_t occupied_{0};
+            std::array<timer_entry*, slots_per_level> slots_{};
+        };
+
+        time_point origin_;
+        // Every tick up to and including elapsed_ has been processed.
+        uint64_t elapsed_{0};
+        std::array<level, level_count> levels_{};
+        // Timers whose deadline had already passed when they were inserted.
+        timer_entry* due_{nullptr};
+        std::size_t size_{0};
+
+        static constexpr uint64_t slot_range(std::size_t lvl) noexcept
+        {
+            return uint64_t{1} << (lvl * level_bits);
+        }
+
+        static constexpr uint64_t level_range(std::size_t lvl) noexcept
+        {
+            return uint64_t{1} << ((lvl + 1) * level_bits);
+        }
+
+        uint64_t to_tick_floor(time_point tp) const noexcept
+        {
+            if (tp <= origin_)
+            {
+                return 0;
+            }
+            return static_cast<uint64_t>(std::chrono::duration_cast<tick_duration>(tp - origin_).count());
+        }
+
+        uint64_t to_tick_ceil(time_point tp) const noexcept
+        {
+            if (tp <= origin_)
+            {
+                return 0;
+            }
+            return static_cast<uint64_t>(std::chrono::ceil<tick_duration>(tp - origin_).count());
+        }
+
+        time_point to_time_point(uint64_t tick) const noexcept
+        {
+            return origin_ + tick_duration{tick};
+        }
+
+        void place(timer_entry& entry) noexcept
+        {
+            if (entry.deadline_ <= elapsed_)
+            {
+                push(due_, entry);
+                entry.bucket_ = due_list;
+                return;
+            }
+
+            // The level is picked by the highest bit in which the deadline
+            // differs from the current time. Deadlines reaching past the next
+            // turn of the top level's current slot wait in the slot before it
+            // and are placed again from there.
+            constexpr std::size_t top = level_count - 1;
+            const uint64_t horizon = (elapsed_ & ~(slot_range(top) - 1)) + level_range(top) - 1;
+            const uint64_t target = std::min(entry.deadline_, horizon);
+            const uint64_t masked = (elapsed_ ^ target) | (slots_per_level - 1);
+            const auto significant = static_cast<std::size_t>(63 - std::countl_zero(masked));
+            const std::size_t lvl = std::min(significant / level_bits, level_count - 1);
+            const auto slot = static_cast<std::size_t>((target >> (lvl * level_bits)) & (slots_per_level - 1));
+
+            push(levels_[lvl].slots_[slot], entry);
+            levels_[lvl].occupied_ |= uint64_t{1} << slot;
+            entry.bucket_ = static_cast<uint32_t>(lvl * slots_per_level + slot);
+        }
+
+        void unlink(timer_entry& entry) noexcept
+        {
+            if (entry.prev_ != nullptr)
+            {
+                entry.prev_->next_ = entry.next_;
+            }
+            else if (entry.bucket_ == due_list)
+            {
+                due_ = entry.next_;
+            }
+            else
+            {
+                auto& lvl = levels_[entry.bucket_ / slots_per_level];
+                const std::size_t slot = entry.bucket_ % slots_per_level;
+                lvl.slots_[slot] = entry.next_;
+                if (entry.next_ == nullptr)
+                {
+                    lvl.occupied_ &= ~(uint64_t{1} << slot);
+                }
+            }
+
+            if (entry.next_ != nullptr)
+            {
+                entry.next_->prev_ = entry.prev_;
+            }
+
+            entry.prev_ = nullptr;
+            entry.next_ = nullptr;
+            entry.linked_ = false;
+        }
+
+        static void push(timer_entry*& head, timer_entry& entry) noexcept
+        {
+            entry.prev_ = nullptr;
+            entry.next_ = head;
+            if (head != nullptr)
+            {
+                head->prev_ = &entry;
+            }
+            head = &entry;
+            entry.linked_ = true;
+        }
+
+        timer_entry* take_slot(std::size_t lvl, std::size_t slot) noexcept
+        {
+            timer_entry* list = levels_[lvl].slots_[slot];
+            levels_[lvl].slots_[slot] = nullptr;
+            levels_[lvl].occupied_ &= ~(uint64_t{1} << slot);
+            return list;
+        }
+
+        template <typename Func>
+        std::size_t drain(timer_entry*& head, Func& f)
+        {
+            std::size_t count{0};
+            while (head != nullptr)
+            {
+                timer_entry* entry = head;
+                head = entry->next_;
+                if (head != nullptr)
+                {
+                    head->prev_ = nullptr;
+                }
+                entry->prev_ = nullptr;
+                entry->next_ = nullptr;
+                entry->linked_ = false;
+                --size_;
+                ++count;
+                f(*entry);
+            }
+            return count;
+        }
+
+        std::optional<expiration> next_expiration() const noexcept
+        {
+            // Lower levels always expire before higher ones.
+            for (std::size_t lvl = 0; lvl < level_count; ++lvl)
+            {
+                const uint64_t occupied = levels_[lvl].occupied_;
+                if (occupied == 0)
+                {
+                    continue;
+                }
+
+                const auto now_slot = static_cast<int>((elapsed_ / slot_range(lvl)) % slots_per_level);
+                const auto zeros = static_cast<std::size_t>(std::countr_zero(std::rotr(occupied, now_slot)));
+                const std::size_t slot = (zeros + static_cast<std::size_t>(now_slot)) % slots_per_level;
+
+                const uint64_t level_start = elapsed_ & ~(level_range(lvl) - 1);
+                uint64_t deadline = level_start + slot * slot_range(lvl);
+                if (deadline <= elapsed_)
+                {
+                    deadline += level_range(lvl);
+                }
+                return expiration{lvl, slot, deadline};
+            }
+            return std::nullopt;
+        }
+};
+
+} // namespace coro::detail
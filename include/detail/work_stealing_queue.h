@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace coro::detail
+{
+
+/*
+ * Single producer, multi consumer run queue owned by one ThreadPool worker.
+ *
+ * Only the owning worker may push() at the bottom. Items leave from the top
+ * in FIFO order, either through pop() by the owner or through steal_into() by
+ * an idle peer, so a coroutine that yields always goes behind older work.
+ * The backing ring grows on demand; retired rings are kept alive until the
+ * queue is destroyed since a concurrent consumer may still be reading them.
+ */
+template <typename T>
+class work_stealing_queue
+{
+    static_assert(std::is_trivially_copyable_v<T>, "work_stealing_queue items must be trivially copyable");
+
+    /*
+     * Slots are stored as relaxed atomic 64 bit words. A thief may read a slot
+     * the owner is overwriting, such a torn copy is always discarded because
+     * the thief's CAS on top_ fails, so T only has to be trivially copyable.
+     */
+    struct ring
+    {
+        static constexpr std::size_t words_ = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        explicit ring(int64_t capacity)
+            : capacity_(capacity)
+            , mask_(capacity - 1)
+            , slots_(std::make_unique<std::atomic<uint64_t>[]>(capacity * words_))
+        {
+
+        }
+
+        T load(int64_t i) const noexcept
+        {
+            uint64_t raw[words_];
+            const auto base = static_cast<std::size_t>(i & mask_) * words_;
+            for (std::size_t w = 0; w < words_; ++w)
+            {
+                raw[w] = slots_[base + w].load(std::memory_order::relaxed);
+            }
+
+            T value;
+            std::memcpy(&value, raw, sizeof(T));
+            return value;
+        }
+
+        void store(int64_t i, T value) noexcept
+        {
+            uint64_t raw[words_]{};
+            std::memcpy(raw, &value, sizeof(T));
+            const auto base = static_cast<std::size_t>(i & mask_) * words_;
+            for (std::size_t w = 0; w < words_; ++w)
+            {
+                slots_[base + w].store(raw[w], std::memory_order::relaxed);
+            }
+        }
+
+        int64_t capacity_;
+        int64_t mask_;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+    };
+
+    public:
+        explicit work_stealing_queue(int64_t capacity = 256)
+        {
+            auto initial = std::make_unique<ring>(round_up_pow2(capacity));
+            ring_.store(initial.get(), std::memory_order::relaxed);
+            rings_.emplace_back(std::move(initial));
+        }
+
+        work_stealing_queue(const work_stealing_queue&) = delete;
+        work_stealing_queue(work_stealing_queue&&) = delete;
+        work_stealing_queue& operator=(const work_stealing_queue&) = delete;
+        work_stealing_queue& operator=(work_stealing_queue&&) = delete;
+        ~work_stealing_queue() = default;
+
+        // Owner only.
+        void push(T value)
+        {
+            int64_t b = bottom_.load(std::memory_order::relaxed);
+            int64_t t = top_.load(std::memory_order::acquire);
+            ring* r = ring_.load(std::memory_order::relaxed);
+
+            if (b - t >= r->capacity_)
+            {
+                r = grow(r, t, b);
+            }
+
+            r->store(b, value);
+            bottom_.store(b + 1, std::memory_order::release);
+        }
+
+        // Safe from any thread, the owner uses it to drain its own queue.
+        std::optional<T> pop() noexcept
+        {
+            int64_t t = top_.load(std::memory_order::acquire);
+            while (true)
+            {
+                int64_t b = bottom_.load(std::memory_order::acquire);
+                if (t >= b)
+                {
+                    return std::nullopt;
+                }
+
+                T value = ring_.load(std::memory_order::acquire)->load(t);
+                if (top_.compare_exchange_weak(t, t + 1, std::memory_order::acq_rel, std::memory_order::acquire))
+                {
+                    return value;
+                }
+            }
+        }
+
+        /*
+         * Moves up to half of this queue into dst, which must be owned by the
+         * calling thread, and returns one of the stolen items to run directly.
+         */
+        std::optional<T> steal_into(work_stealing_queue& dst)
+        {
+            int64_t t = top_.load(std::memory_order::acquire);
+            int64_t b = bottom_.load(std::memory_order::acquire);
+            int64_t n = b - t;
+            if (n <= 0)
+            {
+                return std::nullopt;
+            }
+
+            n = n - n / 2;
+            ring* r = ring_.load(std::memory_order::acquire);
+            T first = r->load(t);
+            T batch[max_steal_batch_];
+            n = std::min(n, static_cast<int64_t>(max_steal_batch_) + 1);
+            for (int64_t i = 1; i < n; ++i)
+            {
+                batch[i - 1] = r->load(t + i);
+            }
+
+            if (!top_.compare_exchange_strong(t, t + n, std::memory_order::acq_rel, std::memory_order::relaxed))
+            {
+                return std::nullopt;
+            }
+
+            for (int64_t i = 1; i < n; ++i)
+            {
+                dst.push(batch[i - 1]);
+            }
+            return first;
+        }
+
+        std::size_t size() const noexcept
+        {
+            int64_t b = bottom_.load(std::memory_order::acquire);
+            int64_t t = top_.load(std::memory_order::acquire);
+            return b > t ? static_cast<std::size_t>(b - t) : 0;
+        }
+
+        bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+    private:
+        static constexpr std::size_t max_steal_batch_{32};
+
+        alignas(64) std::atomic<int64_t> top_{0};
+        alignas(64) std::atomic<int64_t> bottom_{0};
+        alignas(64) std::atomic<ring*> ring_{nullptr};
+        std::vector<std::unique_ptr<ring>> rings_;
+
+        static int64_t round_up_pow2(int64_t n) noexcept
+        {
+            int64_t capacity = 2;
+            while (capacity < n)
+            {
+                capacity <<= 1;
+            }
+            return capacity;
+        }
+
+        ring* grow(ring* old, int64_t t, int64_t b)
+        {
+            auto bigger = std::make_unique<ring>(old->capacity_ * 2);
+            for (int64_t i = t; i < b; ++i)
+            {
+                bigger->store(i, old->load(i));
+            }
+
+            ring* r = bigger.get();
+            rings_.emplace_back(std::move(bigger));
+            ring_.store(r, std::memory_order::release);
+            return r;
+        }
+};
+
+} // namespace coro::detail
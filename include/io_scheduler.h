@@ -1,17 +1,28 @@
 #pragma once
 
+#include <detail/fd_registration.h>
+#include <detail/io_uring.h>
+#include <detail/mpmc_ring.h>
+#include <detail/mpsc_queue.h>
 #include <detail/poll_info.h>
+#include <detail/stop_token.h>
 #include <fd.h>
 #include <poll.h>
 #include <task_container.h>
 #include <thread_pool.h>
 
+#include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <condition_variable>
 #include <functional>
-#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <stop_token>
 #include <sys/eventfd.h>
+#include <sys/types.h>
 #include <thread>
 #include <vector>
 
@@ -21,11 +32,70 @@ class IOScheduler
 {
     using clock = detail::poll_info::clock;
     using time_point = detail::poll_info::time_point;
-    using timed_events = detail::poll_info::timed_events;
+
+    // Queue link of a coroutine scheduled inline, it lives in the awaiter.
+    struct scheduled_node
+    {
+        scheduled_node* next_{nullptr};
+        std::coroutine_handle<> handle_{nullptr};
+    };
+
+    struct reactor;
+
+    /*
+     * stop_callback of a wait. It hands pi to its reactor's io thread, which
+     * cancels it like a timeout. It is its own queue link and lives in the
+     * awaiter, which the io thread keeps alive until it took the request.
+     */
+    struct cancel_request
+    {
+        void operator()() noexcept;
+
+        cancel_request* next_{nullptr};
+        IOScheduler* scheduler_{nullptr};
+        reactor* reactor_{nullptr};
+        detail::poll_info* pi_{nullptr};
+    };
+
+    enum class FileOp : uint8_t
+    {
+        READ,
+        WRITE,
+        FSYNC,
+        FDATASYNC,
+        FALLOCATE
+    };
+
+    /*
+     * A file operation in flight, it lives in its awaiter. The offload pool
+     * queues it through next_ and hands it back to reactor_ the same way
+     * once the blocking call returned.
+     */
+    struct file_request
+    {
+        file_request* next_{nullptr};
+        reactor* reactor_{nullptr};
+        std::coroutine_handle<> awaiting_coroutine_{nullptr};
+        FileOp op_{FileOp::READ};
+        fd_t fd_{-1};
+        // fallocate() mode.
+        int mode_{0};
+        void* buffer_{nullptr};
+        // Bytes to transfer, or the fallocate() length.
+        std::size_t size_{0};
+        off_t offset_{0};
+        int64_t result_{0};
+    };
 
     public:
     class schedule_operation;
     friend schedule_operation;
+    class timer_operation;
+    friend timer_operation;
+    class poll_operation;
+    friend poll_operation;
+    class file_operation;
+    friend file_operation;
 
     enum class ThreadStrategy
     {
@@ -33,34 +103,123 @@ class IOScheduler
         MANUAL
     };
 
+    /*
+     * Where resumed coroutines run. PROCESS_TASKS_ADAPTIVE queues them like
+     * PROCESS_TASKS_INLINE and times each one on the io thread, a coroutine
+     * that ran past options::inline_budget goes to the thread pool for its
+     * next few resumptions before it is tried inline again.
+     */
     enum class ExecutionStrategy
     {
         PROCESS_TASKS_ON_THREAD_POOL,
-        PROCESS_TASKS_INLINE
+        PROCESS_TASKS_INLINE,
+        PROCESS_TASKS_ADAPTIVE
+    };
+
+    /*
+     * Readiness notification mechanism. IO_URING waits for fd readiness with
+     * IORING_OP_POLL_ADD, the io thread submits what it queued and reaps
+     * timer, schedule and poll completions in one io_uring_enter() call. It
+     * falls back to EPOLL when the kernel is older than 5.11 or io_uring is
+     * disabled, backend() reports what is in use.
+     */
+    enum class Backend
+    {
+        EPOLL,
+        IO_URING
     };
 
     struct options
     {
-        ThreadStrategy thread_strategy{ThreadStrategt::SPAWN};
+        ThreadStrategy thread_strategy{ThreadStrategy::SPAWN};
         std::function<void()> on_io_thread_start_functor{nullptr};
         std::function<void()> on_io_thread_stop_functor{nullptr};
-        thread_pool::options pool{
+        ThreadPool::options pool{
         .thread_count = std::thread::hardware_concurrency(),
         .on_thread_start_functor = nullptr,
         .on_thread_stop_functor = nullptr};
 
-        const ExecutionStrategy execution_strategy{ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL};
+        ExecutionStrategy execution_strategy{ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL};
+        Backend backend{Backend::EPOLL};
+        // Submission queue entries of the io_uring backend.
+        uint32_t io_uring_entries{256};
+        /*
+         * Independent event loops, each with its own io thread, timers and
+         * schedule fd. 0 runs one per hardware thread. More than one requires
+         * ThreadStrategy::SPAWN.
+         */
+        std::size_t reactor_count{1};
+        // Events taken from the kernel per epoll_wait() or io_uring reap.
+        std::size_t max_events{16};
+        // Spin on a non-blocking poll for this long before blocking, trades a
+        // busy io thread for lower wakeup latency. 0 always blocks.
+        std::chrono::microseconds busy_poll{0};
+        // PROCESS_TASKS_ADAPTIVE only, the longest a continuation may run on the io thread.
+        std::chrono::microseconds inline_budget{50};
+        // Threads the epoll backend runs blocking file operations on, they
+        // are started as requests queue up. io_uring needs none.
+        std::size_t file_threads{4};
+    };
+
+    // Bucket i counts wakeups that returned [2^(i-1), 2^i) events, bucket 0 empty ones.
+    static constexpr std::size_t event_batch_buckets{16};
+    // Bucket i counts durations of [2^(i-1), 2^i) microseconds, bucket 0 under
+    // one, the last one everything from about 16ms up.
+    static constexpr std::size_t latency_buckets{16};
+
+    struct reactor_metrics
+    {
+        uint64_t wakeups;
+        uint64_t events;
+        // Wakeups whose events were found while busy polling.
+        uint64_t busy_poll_wakeups;
+        std::array<uint64_t, event_batch_buckets> events_per_wakeup;
+        // timerfd_settime() calls, and the ones a new timer's slack made unnecessary.
+        uint64_t timer_rearms;
+        uint64_t timer_rearms_avoided;
+        // PROCESS_TASKS_ADAPTIVE only: continuations run on the io thread, the
+        // ones handed to the thread pool, and inline runs over the budget.
+        uint64_t inline_resumes;
+        uint64_t offloaded_resumes;
+        uint64_t budget_overruns;
+        /*
+         * Event loop iterations, the time they spent waiting for the kernel
+         * (busy polling included) and the time they spent handling what it
+         * returned, in total and per iteration.
+         */
+        uint64_t loop_iterations;
+        std::chrono::nanoseconds blocked_time;
+        std::chrono::nanoseconds busy_time;
+        std::array<uint64_t, latency_buckets> loop_duration;
+        // How long after its deadline, slack included, each timer expired.
+        std::array<uint64_t, latency_buckets> timer_lateness;
+        // Coroutines resumed per drain of the inline queues, and per batch
+        // of handles_to_resume_, bucketed like events_per_wakeup.
+        std::array<uint64_t, event_batch_buckets> scheduled_batch_size;
+        std::array<uint64_t, event_batch_buckets> resume_batch_size;
+    };
+
+    struct metrics_snapshot
+    {
+        std::vector<reactor_metrics> reactors;
     };
 
     explicit IOScheduler(options opts = options{
-            .thread_strategy = THREAD_STRATEGY::SPAWN,
+            .thread_strategy = ThreadStrategy::SPAWN,
             .on_io_thread_start_functor = nullptr,
             .on_io_thread_stop_functor = nullptr,
-            .poll = {
+            .pool = {
                 .thread_count = std::thread::hardware_concurrency(),
                 .on_thread_start_functor = nullptr,
                 .on_thread_stop_functor = nullptr},
-                .execution_strategy = ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL});
+            .execution_strategy = ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL,
+            .backend = Backend::EPOLL,
+            .io_uring_entries = 256,
+            .reactor_count = 1,
+            .max_events = 16,
+            .busy_poll = std::chrono::microseconds{0},
+            .inline_budget = std::chrono::microseconds{50},
+            .file_threads = 4});
 
     IOScheduler(const IOScheduler&) = delete;
     IOScheduler(IOScheduler&&) = delete;
@@ -71,13 +230,28 @@ class IOScheduler
 
     std::size_t process_events(std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
 
+    /*
+     * For ThreadStrategy::MANUAL, an fd that polls readable whenever
+     * process_events() has something to do: the epoll fd, or the io_uring
+     * ring fd. Timer expiries make it readable too, so a foreign event loop
+     * can wait on it alone and call process_events(0ms) when it fires.
+     */
+    fd_t poll_fd() const noexcept
+    {
+        const auto& r = *reactors_.front();
+        return r.uring_ != nullptr ? r.uring_->fd() : r.epoll_fd_;
+    }
+
+    // Earliest pending timer of the first reactor, nullopt when none is armed.
+    std::optional<time_point> next_deadline() const;
+
     class schedule_operation
     {
         friend class IOScheduler;
         explicit schedule_operation(IOScheduler& scheduler) noexcept
-            : scheduler(scheduler)
+            : scheduler_(scheduler)
         {
-        
+
         }
 
         public:
@@ -88,21 +262,10 @@ class IOScheduler
 
         void await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
         {
-            if (scheduler_.opts_.execution_strategy == ExecutionStrategy::PROCESS_TASKS_INLINE)
+            if (scheduler_.queues_inline())
             {
-                scheduler_.size_.fetch_add(1, std::memory_order::release)
-                {
-                    std::scoped_lock lock{scheduler_.scheduled_tasks_mtx_};
-                    scheduler_.scheduled_tasks_.emplace_back(awaiting_coroutine);
-                }
-
-                bool expected{false};
-                if(scheduler_.schedule_fd_triggered_.compare_exchange_strong(
-                            expected, true, std::memory_order::release, std::memory_order::relaxed))
-                {
-                    eventfd_t value{1};
-                    eventfd_write(scheduler_.schedule_fd_, value);
-                }
+                node_.handle_ = awaiting_coroutine;
+                scheduler_.schedule_inline(scheduler_.local_reactor(), node_);
             }
             else
             {
@@ -112,62 +275,261 @@ class IOScheduler
 
         void await_resume()
         {
-        
+
         }
 
         private:
         IOScheduler& scheduler_;
+        scheduled_node node_{};
     };
 
-    schedule_operation schedule() 
+    schedule_operation schedule()
     {
         return schedule_operation{*this};
     }
 
-    void schedule(coro::task<void>&& task)
+    void schedule(coro::Task<void>&& task)
     {
-        auto* ptr = static_cast<coro::task_container<coro::io_scheduler>*>(owned_tasks_);
+        auto* ptr = static_cast<coro::TaskContainer<coro::IOScheduler>*>(owned_tasks_);
         ptr->start(std::move(task));
     }
 
-    [[nodiscard]] coro::task<void> schedule_after(std::chrono::milliseconds amount);
+    /*
+     * Awaiter of yield_for() and yield_until(). The timer hook is part of the
+     * awaiter, which lives in the awaiting coroutine's frame, so a timed wait
+     * allocates nothing. Resumes with TIMEOUT, or CANCELLED when the awaiting
+     * coroutine's stop_token fires first.
+     */
+    class timer_operation
+    {
+        friend class IOScheduler;
+        timer_operation(IOScheduler& scheduler, time_point deadline, std::chrono::milliseconds slack,
+                bool expired) noexcept
+            : scheduler_(scheduler)
+            , deadline_(deadline)
+            , slack_(slack)
+            , expired_(expired)
+        {
 
-    [[nodiscard]] coro::task<void> schedule_at(time_point time);
+        }
+
+        public:
+        // Only moved before it is awaited, e.g. into when_all().
+        timer_operation(timer_operation&& other) noexcept
+            : scheduler_(other.scheduler_)
+            , deadline_(other.deadline_)
+            , slack_(other.slack_)
+            , expired_(other.expired_)
+        {
+
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        template <typename awaiting_promise>
+        bool await_suspend(std::coroutine_handle<awaiting_promise> awaiting_coroutine) noexcept
+        {
+            return suspend(awaiting_coroutine, detail::stop_token_of(awaiting_coroutine));
+        }
+
+        PollStatus await_resume() noexcept;
+
+        private:
+        bool suspend(std::coroutine_handle<> awaiting_coroutine, const std::stop_token& token) noexcept;
+
+        IOScheduler& scheduler_;
+        time_point deadline_;
+        std::chrono::milliseconds slack_;
+        // A deadline already passed yields like schedule() does.
+        bool expired_;
+        bool suspended_{false};
+        scheduled_node node_{};
+        detail::poll_info pi_{};
+        // Declared after pi_, its destructor waits out a callback still running.
+        std::optional<std::stop_callback<cancel_request>> stop_callback_{};
+    };
+
+    /*
+     * Awaiter of poll(). Like timer_operation it carries its poll_info, the fd
+     * event and the timeout point straight into the awaiting coroutine's frame.
+     * A stop request removes both and resumes with CANCELLED.
+     */
+    class poll_operation
+    {
+        friend class IOScheduler;
+        poll_operation(IOScheduler& scheduler, reactor& r, fd_t fd, coro::PollOption op,
+                std::chrono::milliseconds timeout, detail::fd_registration* reg) noexcept;
+
+        public:
+        // Only moved before it is awaited, e.g. into when_all().
+        poll_operation(poll_operation&& other) noexcept
+            : poll_operation(other.scheduler_, other.reactor_, other.pi_.fd_, other.op_, other.timeout_, other.reg_)
+        {
+
+        }
+
+        // Registered fds complete here when their readiness is already cached.
+        bool await_ready() noexcept;
+
+        template <typename awaiting_promise>
+        bool await_suspend(std::coroutine_handle<awaiting_promise> awaiting_coroutine) noexcept
+        {
+            return suspend(awaiting_coroutine, detail::stop_token_of(awaiting_coroutine));
+        }
+
+        PollStatus await_resume() noexcept;
+
+        private:
+        bool suspend(std::coroutine_handle<> awaiting_coroutine, const std::stop_token& token) noexcept;
+
+        IOScheduler& scheduler_;
+        reactor& reactor_;
+        detail::fd_registration* reg_;
+        coro::PollOption op_;
+        std::chrono::milliseconds timeout_;
+        bool suspended_{false};
+        detail::poll_info pi_{};
+        std::optional<std::stop_callback<cancel_request>> stop_callback_{};
+    };
+
+    /*
+     * Timed waits may resume up to slack after their deadline. The reactor
+     * then arms its timerfd for a boundary shared by nearby deadlines, and
+     * leaves it alone when it is already armed within the window, instead of
+     * moving it for every earlier timer.
+     */
+    [[nodiscard]] timer_operation schedule_after(std::chrono::milliseconds amount,
+            std::chrono::milliseconds slack = std::chrono::milliseconds{0});
+
+    [[nodiscard]] timer_operation schedule_at(time_point time,
+            std::chrono::milliseconds slack = std::chrono::milliseconds{0});
 
     [[nodiscard]] schedule_operation yield()
     {
         return schedule_operation{*this};
     }
 
-    [[nodiscard]] coro::task<void> yield_for(std::chrono::milliseconds amount);
+    [[nodiscard]] timer_operation yield_for(std::chrono::milliseconds amount,
+            std::chrono::milliseconds slack = std::chrono::milliseconds{0});
 
-    [[nodiscard]] coro::task<void> yield_until(time_point time);
+    [[nodiscard]] timer_operation yield_until(time_point time,
+            std::chrono::milliseconds slack = std::chrono::milliseconds{0});
 
-    [[nodiscard]] coro::task<pool_status> poll(fd_t fd, coro::poll_op op,
+    // fd is watched by reactor_for(fd).
+    [[nodiscard]] poll_operation poll(fd_t fd, coro::PollOption op,
             std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
 
-    [[nodiscard]] coro::task<poll_status> poll(const net::socket& sock, coro::poll_op op,
-            std::chrono::milliseconds timeout = std::chrono::milliseconds{0})
+    // Watches fd on the given reactor, which is taken modulo reactor_count().
+    [[nodiscard]] poll_operation poll(fd_t fd, coro::PollOption op,
+            std::chrono::milliseconds timeout, std::size_t reactor);
+
+    /*
+     * An fd that stays registered with one reactor, edge triggered, until the
+     * handle is destroyed. Polls on it consume the cached readiness, so like
+     * any edge triggered wait, read or write until EAGAIN before polling
+     * again. At most one poll per direction may be pending, none when the
+     * handle is destroyed, and the handle must not outlive the scheduler.
+     */
+    class registered_fd
     {
-        return poll(sock.native_handle(), op, timeout);
-    }
+        public:
+            registered_fd() = default;
+            registered_fd(const registered_fd&) = delete;
+            registered_fd& operator=(const registered_fd&) = delete;
+            registered_fd(registered_fd&& other) noexcept;
+            registered_fd& operator=(registered_fd&& other) noexcept;
+            ~registered_fd();
+
+            fd_t fd() const noexcept
+            {
+                return reg_ != nullptr ? reg_->fd_ : -1;
+            }
 
-    void resume(std::coroutine_handle<> handle)
+        private:
+            friend class IOScheduler;
+            registered_fd(IOScheduler& scheduler, reactor& r, detail::fd_registration& reg) noexcept;
+
+            IOScheduler* scheduler_{nullptr};
+            reactor* reactor_{nullptr};
+            detail::fd_registration* reg_{nullptr};
+    };
+
+    /*
+     * Registers fd with reactor_for(fd) for the given directions. Every edge
+     * wakes the reactor whether a poll waits or not, so register only the
+     * directions that will be polled.
+     */
+    [[nodiscard]] registered_fd register_fd(fd_t fd, coro::PollOption interest = coro::PollOption::READ_WRITE);
+
+    [[nodiscard]] registered_fd register_fd(fd_t fd, coro::PollOption interest, std::size_t reactor);
+
+    // Waits for READ or WRITE readiness, completes inline when it is already cached.
+    [[nodiscard]] poll_operation poll(registered_fd& fd, coro::PollOption op,
+            std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+    /*
+     * Awaiter of the file operations. Regular files are always "ready" to
+     * epoll, so the io_uring backend submits the operation itself and the
+     * epoll backend runs the blocking call on the file offload pool. Either
+     * way the awaiting coroutine resumes through its reactor like a poll(),
+     * or straight on the thread pool when that is where it would go. The
+     * epoll backend first tries a read with RWF_NOWAIT, data already in the
+     * page cache completes without suspending. Resumes with what the syscall
+     * returned, or -errno.
+     */
+    class file_operation
     {
-        if (opts_.execution_strategy == ExecutionStragtegy::PROCESS_TASKS_INLINE)
+        friend class IOScheduler;
+        file_operation(IOScheduler& scheduler, const file_request& request) noexcept
+            : scheduler_(scheduler)
+            , request_(request)
         {
-            {
-                std::scoped_lock{scheduled_tasks_mtx_};
-                scheduled_tasks_.emplace_back(handle);
-            }
 
-            bool expected{false}
-            if (schedule_fd_triggered_.compare_exchange_strong(
-                        expected, true, std::memory_order::relase, std::memory_order::relaxed))
-            {
-                eventfd_t value{1};
-                eventfd_write(schedule_fd_, value);
-            }
+        }
+
+        public:
+        // Only moved before it is awaited, e.g. into when_all().
+        file_operation(file_operation&& other) noexcept
+            : scheduler_(other.scheduler_)
+            , request_(other.request_)
+        {
+
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept;
+
+        int64_t await_resume() noexcept;
+
+        private:
+        IOScheduler& scheduler_;
+        file_request request_;
+        bool suspended_{false};
+    };
+
+    // pread(), the number of bytes read may be short.
+    [[nodiscard]] file_operation read_at(fd_t fd, void* buffer, std::size_t size, off_t offset);
+
+    // pwrite(), the number of bytes written may be short.
+    [[nodiscard]] file_operation write_at(fd_t fd, const void* buffer, std::size_t size, off_t offset);
+
+    // fsync(), or fdatasync() when data_only is set.
+    [[nodiscard]] file_operation fsync(fd_t fd, bool data_only = false);
+
+    [[nodiscard]] file_operation fallocate(fd_t fd, int mode, off_t offset, off_t length);
+
+    void resume(std::coroutine_handle<> handle)
+    {
+        if (queues_inline())
+        {
+            schedule_inline(local_reactor(), handle);
         }
         else
         {
@@ -177,7 +539,7 @@ class IOScheduler
 
     std::size_t size() const noexcept
     {
-        if (opts_.execution_strategy == ExecutionStrategy::PROCESS_TASKS_INLINE)
+        if (thread_pool_ == nullptr)
         {
             return size_.load(std::memory_order::acquire);
         }
@@ -192,51 +554,253 @@ class IOScheduler
         return size() == 0;
     }
 
+    Backend backend() const noexcept
+    {
+        return reactors_.front()->uring_ != nullptr ? Backend::IO_URING : Backend::EPOLL;
+    }
+
+    std::size_t reactor_count() const noexcept
+    {
+        return reactors_.size();
+    }
+
+    // The reactor an fd is assigned to when poll() is not told otherwise.
+    std::size_t reactor_for(fd_t fd) const noexcept
+    {
+        return static_cast<std::size_t>(fd) % reactors_.size();
+    }
+
+    metrics_snapshot metrics() const;
+
     void shutdown() noexcept;
 
+    void garbage_collect() noexcept;
+
     private:
+    static const constexpr std::chrono::milliseconds default_timeout_{1000};
+    static const constexpr std::chrono::milliseconds no_timeout_{0};
+    static const constexpr std::size_t resumed_capacity_ = 1024;
+    // Adaptive mode remembers this many overrunning coroutines per reactor,
+    // each goes to the thread pool this many times before it is timed again.
+    static const constexpr std::size_t overrun_slots_ = 256;
+    static const constexpr uint32_t overrun_offloads_ = 8;
+
+    /*
+     * A coroutine that ran past the inline budget, keyed by its frame address.
+     * Frames are recycled, the resume function the frame starts with tells
+     * another coroutine that got the same address apart.
+     */
+    struct overrun
+    {
+        void* address_{nullptr};
+        void* resume_{nullptr};
+        uint32_t offloads_left_{0};
+    };
+
+    /*
+     * One event loop. Everything it owns is only touched by its io thread,
+     * except the timers, the inline task queue and io_uring submissions,
+     * which have their own locks.
+     */
+    struct reactor
+    {
+        IOScheduler* scheduler_{nullptr};
+        fd_t epoll_fd_{-1};
+        fd_t timer_fd_{-1};
+        fd_t schedule_fd_{-1};
+        std::atomic<bool> schedule_fd_triggered_{false};
+        std::atomic<bool> io_processing_{false};
+        std::thread io_thread_;
+
+        // Set when the io_uring backend is in use. epoll_fd_ then only holds
+        // registered fds, and only when the kernel lacks multishot polls.
+        std::unique_ptr<detail::io_uring> uring_{nullptr};
+        // Serialises submissions, poll() runs on any thread. Entries queued by
+        // the io thread itself wait for its next io_uring_enter().
+        std::mutex uring_mtx_{};
+
+        std::mutex timed_events_mtx_{};
+        detail::timer_wheel timed_events_{};
+        // Deadline timer_fd_ is armed for, max() when disarmed.
+        time_point armed_deadline_{time_point::max()};
+        // Reused by process_timeout_execute() to batch expired timers.
+        std::vector<detail::poll_info*> timed_out_{};
+
+        // Inline mode queues. schedule() links the node in its awaiter,
+        // resume() pushes bare handles to the ring and only falls back to
+        // the locked vector when that is full.
+        detail::mpsc_queue<scheduled_node> scheduled_{};
+        // Stop requests of waits on this reactor, taken on the schedule wakeup.
+        detail::mpsc_queue<cancel_request> cancelled_{};
+        // File operations the offload pool finished, taken on the same wakeup.
+        detail::mpsc_queue<file_request> files_done_{};
+        detail::mpmc_ring<void*> resumed_{resumed_capacity_};
+        std::atomic<std::size_t> overflowed_{0};
+        std::mutex scheduled_tasks_mtx_{};
+        std::vector<std::coroutine_handle<>> scheduled_tasks_{};
+
+        // Registrations whose handle is gone, freed by the io thread.
+        std::mutex retired_mtx_{};
+        std::vector<detail::fd_registration*> retired_{};
+
+        std::vector<struct epoll_event> events_{};
+        std::vector<std::coroutine_handle<>> handles_to_resume_{};
+        // When the kernel returned the batch being handled.
+        time_point woke_{};
+        std::array<overrun, overrun_slots_> overruns_{};
+
+        // Single writer counters, bumped with a plain load/store instead of an RMW.
+        std::atomic<uint64_t> wakeups_{0};
+        std::atomic<uint64_t> events_seen_{0};
+        std::atomic<uint64_t> busy_poll_wakeups_{0};
+        std::array<std::atomic<uint64_t>, event_batch_buckets> events_per_wakeup_{};
+        // Only written with timed_events_mtx_ held.
+        std::atomic<uint64_t> timer_rearms_{0};
+        std::atomic<uint64_t> timer_rearms_avoided_{0};
+        std::atomic<uint64_t> inline_resumes_{0};
+        std::atomic<uint64_t> offloaded_resumes_{0};
+        std::atomic<uint64_t> budget_overruns_{0};
+        std::atomic<uint64_t> loop_iterations_{0};
+        std::atomic<uint64_t> blocked_ns_{0};
+        std::atomic<uint64_t> busy_ns_{0};
+        std::array<std::atomic<uint64_t>, latency_buckets> loop_duration_{};
+        std::array<std::atomic<uint64_t>, latency_buckets> timer_lateness_{};
+        std::array<std::atomic<uint64_t>, event_batch_buckets> scheduled_batch_size_{};
+        std::array<std::atomic<uint64_t>, event_batch_buckets> resume_batch_size_{};
+    };
+
+    // Whether resumed coroutines are queued to a reactor rather than the thread pool.
+    bool queues_inline() const noexcept
+    {
+        return opts_.execution_strategy != ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL;
+    }
+
+    // Runs handle on the io thread, or on the thread pool in adaptive mode
+    // when it recently overran the inline budget.
+    void run_continuation(reactor& r, std::coroutine_handle<> handle);
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) noexcept
+    {
+        counter.store(counter.load(std::memory_order::relaxed) + amount, std::memory_order::relaxed);
+    }
+
+    // Bumps the power of two bucket value falls in, the last one takes the rest.
+    template <std::size_t bucket_count>
+    static void record(std::array<std::atomic<uint64_t>, bucket_count>& histogram, uint64_t value) noexcept
+    {
+        bump(histogram[std::min<std::size_t>(std::bit_width(value), bucket_count - 1)]);
+    }
+
+    // Accounts for one return from the kernel that produced count events.
+    static void record_wakeup(reactor& r, std::size_t count, bool busy) noexcept;
+    // Accounts for one event loop iteration that started waiting at start.
+    static void record_iteration(reactor& r, time_point start) noexcept;
+
     options opts_;
-    fd_t epoll_fd_{-1};
     fd_t shutdown_fd_{-1};
-    fd_t timer_fd_{-1};
-    fd_t schedule_fd_{-1};
-    std::atomic<bool> schedule_fd_triggered_{false};
     std::atomic<std::size_t> size_{0};
-    std::thread io_thread_;
-    std::unique_ptr<thread_pool> thread_pool_{nullptr};
-    std::mutex timed_events_mtx_{};
-    timed_events timed_events_{};
+    std::unique_ptr<ThreadPool> thread_pool_{nullptr};
     std::atomic<bool> shutdown_requested_{false};
-    std::atomic<bool> io_processing_{false};
-
-    void process_events_manual(std::chrono::milliseconds timeout);
-    void process_events_dedicated_thread();
-    void process_events_execute(std::chrono::milliseconds timeout);
-    static pool_status event_to_poll_status(uint32_t events);
-    void process_scheduled_execute_inline();
-    std::mutex scheduled_tasks_mtx_{};
-    std::vector<std::coroutine_handle<>> scheduled_tasks_{};
+    std::vector<std::unique_ptr<reactor>> reactors_{};
+
+    // File offload pool of the epoll backend, a FIFO of requests linked
+    // through next_ and at most opts_.file_threads threads draining it.
+    std::mutex file_mtx_{};
+    std::condition_variable file_cv_{};
+    file_request* file_head_{nullptr};
+    file_request* file_tail_{nullptr};
+    std::size_t file_queued_{0};
+    std::size_t file_idle_{0};
+    bool file_stop_{false};
+    std::vector<std::thread> file_threads_{};
+
+    // The reactor whose io thread is running on this thread, if any.
+    static thread_local reactor* current_reactor_;
+
+    // The calling thread's reactor, other threads are spread over all of them.
+    reactor& local_reactor() noexcept;
+    void schedule_inline(reactor& r, scheduled_node& node);
+    void schedule_inline(reactor& r, std::coroutine_handle<> handle);
+    // Writes the schedule eventfd unless a wakeup is already pending.
+    void wake_inline(reactor& r);
+
+    void process_events_manual(reactor& r, std::chrono::milliseconds timeout);
+    void process_events_dedicated_thread(reactor& r);
+    void process_events_execute(reactor& r, std::chrono::milliseconds timeout);
+    void process_events_execute_uring(reactor& r, std::chrono::milliseconds timeout);
+    static PollStatus event_to_poll_status(uint32_t events);
+    void process_scheduled_execute_inline(reactor& r);
 
     void* owned_tasks_{nullptr};
-    
+
     static constexpr const int shutdown_object_{0};
-    static constexpr const void* shutdown_ptr = &shutdown_object_;
+    static constexpr const void* shutdown_ptr_ = &shutdown_object_;
     static constexpr const int timer_object_{0};
-    static constexpr const void* timer_ptr = &timer_object_;
+    static constexpr const void* timer_ptr_ = &timer_object_;
     static constexpr const int schedule_object_{0};
-    static constexpr const void* schedule_ptr = &schedule_object_;
-
-    static const constexpr std::chrono::milliseconds default_timeout_{1000};
-    static const constexpr std::chrono::milliseconds no_timeout_{0};
-    static const constexpr std::size_t max_events_ = 16;
-    std::array<struct epoll_event, max_events_> events_;
-    std::vector<std::coroutine_handle<>> handles_to_resume_{};
-
-    void process_event_execute(detail::poll_info* pi, poll_status status);
-    void process_timeout_execute();
-    timed_events::iterator add_timer_token(time_point tp, detail::poll_info& pi);
-    void remove_timer_token(timed_events::iterator pos);
-    void update_timeout(time_point now);
+    static constexpr const void* schedule_ptr_ = &schedule_object_;
+    // user_data of IORING_OP_POLL_REMOVE requests, their completions are ignored.
+    static constexpr const int cancel_object_{0};
+    static constexpr const void* cancel_ptr_ = &cancel_object_;
+    // user_data of the io_uring poll on epoll_fd_ when it holds registered fds.
+    static constexpr const int registrations_object_{0};
+    static constexpr const void* registrations_ptr_ = &registrations_object_;
+    // Set in the user_data of registered fds to tell them from poll_infos.
+    static constexpr uintptr_t registration_tag_{1};
+    // Set in the user_data of file operations.
+    static constexpr uintptr_t file_tag_{2};
+
+    // Registers fd with the backend, completions carry user_data. Returns
+    // false when epoll refused fd, io_uring reports that in the completion.
+    bool arm_poll(reactor& r, fd_t fd, uint32_t events, const void* user_data);
+    // Watches one of the reactor's own eventfds or its timerfd for EPOLLIN.
+    void arm_wakeup(reactor& r, fd_t fd, const void* user_data);
+    // Called with uring_mtx_ held after queueing entries.
+    static void submit_sqes(reactor& r);
+    // Stops watching pi's fd. Returns false when the io_uring backend still
+    // holds a reference that is released by a later completion.
+    bool disarm_poll(reactor& r, detail::poll_info& pi);
+    // Called with uring_mtx_ held, flushes the submission queue when it is full.
+    static io_uring_sqe& next_sqe(reactor& r);
+
+    // Adds reg to the reactor's multishot polls or its epoll fd, returns
+    // false when epoll refuses the fd.
+    bool arm_registration(reactor& r, detail::fd_registration& reg);
+    // Called with uring_mtx_ held, submits reg's multishot poll.
+    void submit_registration(reactor& r, detail::fd_registration& reg);
+    void unregister_fd(reactor& r, detail::fd_registration& reg) noexcept;
+    // Frees released registrations, only called by the io thread between batches.
+    void free_released(reactor& r);
+
+    // Arms pi's stop_callback, before pi is published.
+    void watch_stop(reactor& r, detail::poll_info& pi, const std::stop_token& token,
+            std::optional<std::stop_callback<cancel_request>>& callback) noexcept;
+    // Called by pi's awaiter once it armed everything, last.
+    static void publish(detail::poll_info& pi) noexcept;
+    // Blocks the io thread until pi is published, briefly since the awaiter is mid-suspend.
+    static void wait_published(detail::poll_info& pi) noexcept;
+    // Queues pi's coroutine to resume, unless a stop request still holds pi.
+    void resume_poll(reactor& r, detail::poll_info& pi);
+    void process_cancelled_execute(reactor& r);
+    void process_event_execute(reactor& r, detail::poll_info* pi, PollStatus status);
+    void process_registration_execute(reactor& r, detail::fd_registration& reg, uint32_t events);
+    void wake_registered(reactor& r, detail::fd_registration& reg, std::atomic<detail::poll_info*>& slot,
+            uint32_t events, uint32_t mask, uint32_t consumed);
+    void process_timeout_execute(reactor& r);
+    void add_timer_token(reactor& r, time_point tp, detail::poll_info& pi,
+            std::chrono::milliseconds slack = std::chrono::milliseconds{0});
+    void remove_timer_token(reactor& r, detail::poll_info& pi);
+    // Called with timed_events_mtx_ held, arms timer_fd_ for the next deadline.
+    void update_timeout(reactor& r, time_point now);
+
+    void submit_file(reactor& r, file_request& request);
+    void offload_file(file_request& request);
+    // Resumes request's coroutine once the offload pool ran it.
+    void complete_file(file_request& request);
+    void process_files_offloaded();
+    static int64_t execute_file(const file_request& request) noexcept;
+    void process_files_done_execute(reactor& r);
+    void stop_file_threads() noexcept;
 
 };
 } // namespace coro
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <sys/epoll.h>
 
 namespace coro
@@ -13,12 +15,12 @@ enum class PollOption : uint64_t
 
 inline bool poll_op_readable(PollOption op)
 {
-    return (static_cast<uint64_t>(op) & PollOption::READ);
+    return (static_cast<uint64_t>(op) & EPOLLIN);
 }
 
 inline bool poll_op_writeable(PollOption op)
 {
-    return (static_cast<uint64_t>(op) & PollOption::WRITE);
+    return (static_cast<uint64_t>(op) & EPOLLOUT);
 }
 
 enum class PollStatus
@@ -26,7 +28,9 @@ enum class PollStatus
     EVENT,
     TIMEOUT,
     ERROR,
-    CLOSED
+    CLOSED,
+    // The awaiting coroutine's stop_token was triggered before the wait ended.
+    CANCELLED
 };
 
 } // namespace coro
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <concepts/promise.h>
+#include <detail/frame_allocator.h>
+#include <detail/stop_token.h>
 
 #include <coroutine>
 #include <exception>
+#include <memory>
+#include <stop_token>
 #include <utility>
 
 namespace coro
@@ -44,6 +48,37 @@ struct promise_base
     promise_base() noexcept = default;
     ~promise_base() = default;
 
+#if defined(CORO_FRAME_ALLOCATOR)
+    // Frames come from per thread size class free lists, see frame_allocator.
+    static auto operator new(std::size_t size) -> void* { return frame_allocator::allocate(size); }
+#else
+    static auto operator new(std::size_t size) -> void* { return frame_allocator::allocate_unpooled(size); }
+#endif
+
+    /*
+     * A coroutine whose parameters start with std::allocator_arg and an
+     * allocator, e.g. a std::pmr::polymorphic_allocator over a per request
+     * arena, gets its frame from that allocator. A copy of it is kept with
+     * the frame to free it, the arena must outlive the task. The second
+     * overload is for member functions and lambdas, whose object comes first.
+     * GCC before 14 takes these for a mismatch with operator delete at -O0,
+     * see -Wno-mismatched-new-delete in examples/CMakeLists.txt.
+     */
+    template <typename Alloc, typename... Args>
+    static auto operator new(std::size_t size, std::allocator_arg_t, const Alloc& alloc, const Args&...) -> void*
+    {
+        return frame_allocator::allocate(size, alloc);
+    }
+
+    template <typename This, typename Alloc, typename... Args>
+    static auto operator new(std::size_t size, const This&, std::allocator_arg_t, const Alloc& alloc, const Args&...)
+        -> void*
+    {
+        return frame_allocator::allocate(size, alloc);
+    }
+
+    static auto operator delete(void* ptr, std::size_t size) noexcept -> void { frame_allocator::deallocate(ptr, size); }
+
     auto initial_suspend() { return std::suspend_always{}; }
 
     auto final_suspend() noexcept(true) { return final_awaitable{}; }
@@ -52,9 +87,15 @@ struct promise_base
 
     auto continuation(std::coroutine_handle<> continuation) noexcept -> void { continuation_ = continuation; }
 
+    auto get_stop_token() const noexcept -> std::stop_token { return stop_token_; }
+
+    auto set_stop_token(std::stop_token token) noexcept -> void { stop_token_ = std::move(token); }
+
     protected:
         std::coroutine_handle<> continuation_{nullptr};
         std::exception_ptr p_exception_{};
+        // Handed down to whatever this coroutine awaits, see Task::set_stop_token().
+        std::stop_token stop_token_{};
 };
 
 template <typename return_type>
@@ -131,9 +172,17 @@ class [[nodiscard]] Task
 
             auto await_ready() const noexcept -> bool { return !coroutine_ || coroutine_.done(); }
 
-            auto await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept -> std::coroutine_handle<>
+            // A task without a stop_token of its own inherits the awaiting coroutine's.
+            template <typename awaiting_promise>
+            auto await_suspend(std::coroutine_handle<awaiting_promise> awaiting_coroutine) noexcept
+                -> std::coroutine_handle<>
             {
-                coroutine_.promise().continuation(awaiting_coroutine);
+                auto& promise = coroutine_.promise();
+                if (!promise.get_stop_token().stop_possible())
+                {
+                    promise.set_stop_token(detail::stop_token_of(awaiting_coroutine));
+                }
+                promise.continuation(awaiting_coroutine);
                 return coroutine_;
             }
 
@@ -164,7 +213,7 @@ class [[nodiscard]] Task
             {
                 if (coroutine_ != nullptr)
                 {
-                    coroutine_.destory();
+                    coroutine_.destroy();
                 }
 
                 coroutine_ = std::exchange(other.coroutine_, nullptr);
@@ -174,6 +223,14 @@ class [[nodiscard]] Task
 
         auto is_ready() const noexcept -> bool { return coroutine_ == nullptr || coroutine_.done(); }
 
+        /*
+         * Lets the task be cancelled through token. The token reaches every
+         * task and when_all() it awaits, and IOScheduler waits in any of them
+         * end with PollStatus::CANCELLED once a stop is requested. Set it
+         * before the task starts.
+         */
+        auto set_stop_token(std::stop_token token) noexcept -> void { coroutine_.promise().set_stop_token(std::move(token)); }
+
         auto resume() -> bool
         {
             if (!coroutine_.done())
@@ -12,7 +12,7 @@
 
 namespace coro
 {
-class IoScheduler;
+class IOScheduler;
 
 template <concepts::executor executor_type>
 class TaskContainer
@@ -27,8 +27,8 @@ class TaskContainer
         };
 
         TaskContainer(std::shared_ptr<executor_type> e,
-                const options opts = {.reserve_size, growth_factor = 2})
-            : growth_factor(opts.growth_factor)
+                const options opts = options{.reserve_size = 8, .growth_factor = 2})
+            : growth_factor_(opts.growth_factor)
             , executor_(std::move(e))
             , p_executor_(executor_.get())
         {
@@ -49,7 +49,7 @@ class TaskContainer
 
         ~TaskContainer()
         {
-            while (!empty)
+            while (!empty())
             {
                 garbage_collect();
             }
@@ -61,7 +61,7 @@ class TaskContainer
             NO
         };
 
-        auto start(coro::Task<void>& user_task, 
+        auto start(coro::Task<void>&& user_task, 
                 GarbageCollect cleanup = GarbageCollect::YES) -> void
         {
             size_.fetch_add(1, std::memory_order::relaxed);
@@ -72,13 +72,13 @@ class TaskContainer
                 _garbage_collect();
             }
 
-            if (free_pos_ = task_indexes.end())
+            if (free_pos_ == task_indexes_.end())
             {
                 free_pos_ = grow();
             }
 
             auto index = *free_pos_;
-            tasks_[index] = make_cleanup_task(std::move(user_task), free_pos);
+            tasks_[index] = make_cleanup_task(std::move(user_task), free_pos_);
             std::advance(free_pos_, 1);
 
             tasks_[index].resume();
@@ -90,7 +90,7 @@ class TaskContainer
             return _garbage_collect();
         }
 
-        auto delete_astk_size() const -> std::size_t
+        auto delete_task_size() const -> std::size_t
         {
             std::atomic_thread_fence(std::memory_order::acquire);
             return tasks_to_delete_.size();
@@ -104,7 +104,7 @@ class TaskContainer
 
         auto size() const -> std::size_t
         {
-            return size_.load(load::memory_order::relaxed);
+            return size_.load(std::memory_order::relaxed);
         }
 
         auto empty() const -> bool 
@@ -138,9 +138,9 @@ class TaskContainer
         std::shared_ptr<executor_type> executor_{nullptr};
         executor_type* p_executor_{nullptr};
 
-        friend IoScheduler;
+        friend IOScheduler;
         TaskContainer(executor_type& e,
-                const options opts = options{.reverse_size = 8, .growth_factor = 2})
+                const options opts = options{.reserve_size = 8, .growth_factor = 2})
             : growth_factor_(opts.growth_factor)
             , p_executor_(&e)
         {
@@ -159,24 +159,24 @@ class TaskContainer
 
         auto grow() -> task_position
         {
-            auto last_pos = std::prev(task_indexes.end());
+            auto last_pos = std::prev(task_indexes_.end());
             std::size_t new_size = tasks_.size() * growth_factor_;
             for (std::size_t i = tasks_.size(); i < new_size; ++i)
             {
-                task_indexes.emplace_back(i);
+                task_indexes_.emplace_back(i);
             }
-            tasks_.resize(new_resize);
+            tasks_.resize(new_size);
             return std::next(last_pos);
         }
 
-        auto _garbage_internal() -> std::size_t
+        auto _garbage_collect() -> std::size_t
         {
             std::size_t deleted{0};
-            if (!tasks_to_delete.empty())
+            if (!tasks_to_delete_.empty())
             {
-                for (const auto& pos : tasks_to_delete)
+                for (const auto& pos : tasks_to_delete_)
                 {
-                    task_indexes.splice(tasks_indexes_.end(), task_indexes_, pos)
+                    task_indexes_.splice(task_indexes_.end(), task_indexes_, pos);
                 }
                 deleted = tasks_to_delete_.size();
                 tasks_to_delete_.clear();
@@ -1,18 +1,27 @@
 #pragma once
 
 #include <concepts/range_of.h>
+#include <detail/futex.h>
+#include <detail/mpmc_ring.h>
+#include <detail/work_stealing_queue.h>
 #include <event.h>
 #include <task.h>
 
+#include <array>
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
 #include <coroutine>
+#include <cstddef>
 #include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
 #include <ranges>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
@@ -22,6 +31,23 @@ namespace coro
 class ThreadPool
 {
     public:
+        /*
+         * Scheduling class of a handle. Each class has its own queues and
+         * workers pick between them by weighted round robin, so HIGH work
+         * skips ahead of a LOW backlog without starving it.
+         */
+        enum class Priority
+        {
+            HIGH,
+            NORMAL,
+            LOW
+        };
+
+        static constexpr std::size_t priority_count{3};
+
+        // Bucket i of the queue wait histogram counts waits of [2^(i-1), 2^i) ns, bucket 0 is 0 ns.
+        static constexpr std::size_t queue_wait_buckets{40};
+
         struct operation
         {
             bool await_ready() noexcept 
@@ -40,22 +66,156 @@ class ThreadPool
                 friend class ThreadPool;
                 ThreadPool& thread_pool_;
                 std::coroutine_handle<> awaiting_coroutine_{nullptr};
+                Priority priority_;
+                // Links the awaiter into the throttled list, parking never allocates.
+                operation* next_{nullptr};
+
+                explicit operation(ThreadPool& tp, Priority priority) noexcept;
+        };
+
+        /*
+         * How an idle worker waits for new work. It first re-checks the queues
+         * spin_rounds times with a cpu pause in between, then yield_rounds times
+         * with std::this_thread::yield(), and only then parks on its own futex.
+         * Set both to 0 to park immediately.
+         */
+        struct idle_options
+        {
+            uint32_t spin_rounds{64};
+            uint32_t yield_rounds{4};
+        };
+
+        /*
+         * Worker placement. NONE leaves it to the kernel. CPU_SET pins worker i
+         * to cpus[i % cpus.size()]. NUMA splits the workers into contiguous
+         * groups, one per NUMA node, and pins each to a CPU of its node,
+         * restricted to cpus when that is not empty. In both pinned modes
+         * external submissions go to the injection queue of the caller's node
+         * and workers steal from peers on their own node first.
+         */
+        enum class Affinity
+        {
+            NONE,
+            CPU_SET,
+            NUMA
+        };
+
+        /*
+         * Passed to the thread start/stop functors. cpu and node are -1 when the
+         * worker is not pinned, it converts to the worker index so functors
+         * taking a std::size_t keep working.
+         */
+        struct thread_info
+        {
+            std::size_t idx;
+            int32_t cpu{-1};
+            int32_t node{-1};
 
-                explicit operation(ThreadPool& tp) noexcept;
+            operator std::size_t() const noexcept
+            {
+                return idx;
+            }
         };
 
         struct options
         {
             uint32_t thread_count = std::thread::hardware_concurrency();
-            std::function<void(std::size_t)> on_thread_start_functor = nullptr;
-            std::function<void(std::size_t)> on_thread_stop_functor = nullptr;
+            std::function<void(const thread_info&)> on_thread_start_functor = nullptr;
+            std::function<void(const thread_info&)> on_thread_stop_functor = nullptr;
+            idle_options idle{};
+            // Dequeue weights for HIGH, NORMAL and LOW, a weight of 0 is treated as 1.
+            std::array<uint32_t, priority_count> priority_weights{8, 4, 1};
+            Affinity affinity{Affinity::NONE};
+            std::vector<uint32_t> cpus{};
+            // Slots in each preallocated lock-free injection ring, per priority class
+            // and node. Submissions beyond it spill into a mutex protected slow path.
+            std::size_t injection_capacity{1024};
+            // Timestamp every handle on enqueue to feed the metrics() queue wait
+            // histogram, costs a clock read on each enqueue and dequeue.
+            bool measure_queue_wait{false};
+            // Upper bound on workers while some are inside a blocking() region,
+            // values below thread_count disable compensation.
+            uint32_t max_thread_count{0};
+            // How long a worker above thread_count stays parked before it exits.
+            std::chrono::milliseconds spare_idle_timeout{std::chrono::seconds{10}};
+            // Consecutive handles a worker may run from its LIFO slot before it
+            // goes back to its queues, 0 disables the slot.
+            uint32_t lifo_budget{3};
+            // Once this many handles are queued, schedule() and yield() park the
+            // awaiting coroutine until the queues drain below low_water_mark and
+            // try_resume() refuses. 0 leaves the queues unbounded.
+            std::size_t high_water_mark{0};
+            // 0 or anything above high_water_mark picks high_water_mark / 2.
+            std::size_t low_water_mark{0};
+            // Preallocated execute() nodes shared by all submitters, more are
+            // allocated on demand when they run out.
+            std::size_t execute_nodes{1024};
+        };
+
+        struct worker_metrics
+        {
+            std::size_t idx;
+            uint64_t tasks_executed;
+            // Successful steal attempts, each one may move a batch of handles.
+            uint64_t steals;
+            std::chrono::nanoseconds busy;
+            std::chrono::nanoseconds idle;
+            std::size_t local_queue_depth;
+        };
+
+        struct metrics_snapshot
+        {
+            std::vector<worker_metrics> workers;
+            std::array<std::size_t, priority_count> queue_depth;
+            std::array<uint64_t, queue_wait_buckets> queue_wait_histogram;
+            uint32_t live_workers;
+            uint32_t blocked_workers;
+            // Coroutines held back by the high water mark.
+            std::size_t throttled;
+        };
+
+        /*
+         * Returned by blocking(). While it is alive the pool counts the calling
+         * worker as blocked and keeps thread_count workers runnable by starting
+         * spare ones, up to options::max_thread_count. Spares exit again once
+         * they stayed idle for options::spare_idle_timeout.
+         */
+        class [[nodiscard]] blocking_region
+        {
+            public:
+                blocking_region(const blocking_region&) = delete;
+                blocking_region(blocking_region&&) = delete;
+                blocking_region& operator=(const blocking_region&) = delete;
+                blocking_region& operator=(blocking_region&&) = delete;
+                ~blocking_region();
+
+            private:
+                friend class ThreadPool;
+                ThreadPool& thread_pool_;
+                bool counted_{false};
+
+                explicit blocking_region(ThreadPool& tp) noexcept;
         };
 
         explicit ThreadPool(
                 options opts = options{
                     .thread_count = std::thread::hardware_concurrency(),
                     .on_thread_start_functor = nullptr,
-                    .on_thread_stop_functor = nullptr});
+                    .on_thread_stop_functor = nullptr,
+                    .idle = {
+                        .spin_rounds = 64,
+                        .yield_rounds = 4},
+                    .priority_weights = {8, 4, 1},
+                    .affinity = Affinity::NONE,
+                    .cpus = {},
+                    .injection_capacity = 1024,
+                    .measure_queue_wait = false,
+                    .max_thread_count = 0,
+                    .spare_idle_timeout = std::chrono::seconds{10},
+                    .lifo_budget = 3,
+                    .high_water_mark = 0,
+                    .low_water_mark = 0,
+                    .execute_nodes = 1024});
 
         ThreadPool(const ThreadPool&) = delete;
         
@@ -67,12 +227,13 @@ class ThreadPool
 
         virtual ~ThreadPool();
 
+        // Workers currently running, spares started by blocking() included.
         uint32_t thread_count() const noexcept
         {
-            return threads_.size();
+            return live_.load(std::memory_order::acquire);
         }
 
-        [[nodiscard]] operation schedule();
+        [[nodiscard]] operation schedule(Priority priority = Priority::NORMAL);
 
         template <typename Func, typename... Args>
         [[nodiscard]] auto schedule(Func& f, Args... args) -> Task<decltype(f(std::forward<Args>(args)...))>
@@ -90,40 +251,133 @@ class ThreadPool
             }
         }
 
-        void resume(std::coroutine_handle<> handle) noexcept;
+        /*
+         * Called from one of this pool's workers the handle goes into that
+         * worker's LIFO slot and runs as soon as the current one suspends,
+         * while the data they share is still in cache. A previous occupant of
+         * the slot moves to the worker's queue where peers can steal it.
+         */
+        void resume(std::coroutine_handle<> handle, Priority priority = Priority::NORMAL) noexcept;
+
+        /*
+         * Fire and forget: runs f() on a worker without creating a coroutine
+         * frame. Callables of up to execute_inline_size bytes are stored in a
+         * pooled queue node, so submitting them does not allocate. f must not
+         * throw, an escaping exception terminates the program.
+         */
+        template <typename Func>
+        void execute(Func&& f, Priority priority = Priority::NORMAL)
+        {
+            using func_type = std::decay_t<Func>;
+
+            if (shutdown_requested_.load(std::memory_order::relaxed))
+            {
+                throw std::runtime_error("coro::ThreadPool is shutting down, unable to execute new tasks");
+            }
+
+            execute_node* node = acquire_node();
+            try
+            {
+                if constexpr (sizeof(func_type) <= execute_inline_size
+                        && alignof(func_type) <= alignof(std::max_align_t))
+                {
+                    ::new (static_cast<void*>(node->storage_)) func_type(std::forward<Func>(f));
+                    node->invoke_ = [](execute_node& n) noexcept
+                    {
+                        auto* fn = std::launder(reinterpret_cast<func_type*>(n.storage_));
+                        (*fn)();
+                        fn->~func_type();
+                    };
+                }
+                else
+                {
+                    ::new (static_cast<void*>(node->storage_)) func_type*(new func_type(std::forward<Func>(f)));
+                    node->invoke_ = [](execute_node& n) noexcept
+                    {
+                        auto* fn = *std::launder(reinterpret_cast<func_type**>(n.storage_));
+                        (*fn)();
+                        delete fn;
+                    };
+                }
+            }
+            catch (...)
+            {
+                release_node(node);
+                throw;
+            }
+
+            size_.fetch_add(1, std::memory_order::release);
+            enqueue(stamp(node), static_cast<std::size_t>(priority));
+        }
+
+        // Captures up to this size are stored inline by execute().
+        static constexpr std::size_t execute_inline_size{48};
+
+        /*
+         * Like resume() but returns false without taking the handle when the
+         * queues are at options::high_water_mark, for callers that cannot
+         * suspend and would rather shed load.
+         */
+        [[nodiscard]] bool try_resume(std::coroutine_handle<> handle, Priority priority = Priority::NORMAL) noexcept;
 
         template <coro::concepts::range_of<std::coroutine_handle<>> range_type>
-        void resume(const range_type& handles) noexcept
+        void resume(const range_type& handles, Priority priority = Priority::NORMAL) noexcept
         {
-            size_.fetch_add(std::size(handles), std::memory_order::release);
+            const auto cls = static_cast<std::size_t>(priority);
             size_t null_handles{0};
+            for (const auto& handle : handles)
+            {
+                if (handle == nullptr) [[unlikely]]
+                {
+                    ++null_handles;
+                }
+            }
 
+            const std::size_t count = std::size(handles) - null_handles;
+            if (count == 0)
+            {
+                return;
+            }
+
+            size_.fetch_add(count, std::memory_order::release);
+
+            if (worker* w = local_worker(); w != nullptr)
             {
-                std::scoped_lock lock{wait_mtx_};
                 for (const auto& handle : handles)
                 {
                     if (handle != nullptr) [[likely]]
                     {
-                        queue_.emplace_back(handle);
-                    }
-                    else
-                    {
-                        ++null_handles;
+                        w->local_queues_[cls].push(stamp(handle));
                     }
                 }
             }
-
-            if (null_handles > 0)
+            else
             {
-                size_.fetch_sub(null_handles, std::memory_order::release);
+                inject(caller_injection_queue(), cls, handles, count);
             }
 
-            wait_cv_.notify_one();
+            notify_workers(count);
+        }
+
+        [[nodiscard]] operation yield(Priority priority = Priority::NORMAL)
+        {
+            return schedule(priority);
         }
 
-        [[nodiscard]] operation yield()
+        /*
+         * Marks the calling worker as blocked until the returned region goes
+         * out of scope, wrap syscalls or locks that may stall the thread:
+         *
+         *     {
+         *         auto region = tp.blocking();
+         *         ::read(fd, buf, len);
+         *     }
+         *
+         * A no-op when not called from one of this pool's workers.
+         */
+        blocking_region blocking() noexcept
         {
-            return schedule();
+            return blocking_region{*this};
         }
 
         void shutdown() noexcept;
@@ -138,29 +392,296 @@ class ThreadPool
             return 0 == size_;
         }
 
-        std::size_t queue_size() const noexcept
-        {
-            std::atomic_thread_fence(std::memory_order::acquire);
-            return queue_.size();
-        }
+        /*
+         * Handles sitting in any queue. Summed over every worker's and
+         * injection queue on each call, so it costs O(workers) and is only
+         * approximate while handles move.
+         */
+        std::size_t queue_size() const noexcept;
+
+        std::size_t queue_size(Priority priority) const noexcept;
 
         bool queue_empty() const noexcept
         {
-            return 0 == queue_.size();
+            return 0 == queue_size();
         }
 
+        /*
+         * Point in time view of the pool. Counters are written by their owning
+         * worker only and read here with relaxed loads, so the numbers across
+         * workers are not one consistent cut.
+         */
+        metrics_snapshot metrics() const;
+
     private:
+        using clock = std::chrono::steady_clock;
+
+        struct execute_node
+        {
+            // Runs and destroys the stored callable.
+            void (*invoke_)(execute_node&) noexcept;
+            alignas(std::max_align_t) std::byte storage_[execute_inline_size];
+        };
+
+        struct queued_handle
+        {
+            // Coroutine frame address, or an execute_node with execute_tag set.
+            uintptr_t item_;
+            // clock ticks in ns at enqueue, 0 when queue wait is not measured.
+            uint64_t enqueued_ns_;
+        };
+
+        static constexpr uintptr_t execute_tag{1};
+        static_assert(alignof(execute_node) > execute_tag, "execute_tag must fit in the node alignment");
+
+        // Single writer counters, bumped with a plain load/store instead of an RMW.
+        struct alignas(64) worker_counters
+        {
+            std::atomic<uint64_t> tasks_executed_{0};
+            std::atomic<uint64_t> steals_{0};
+            std::atomic<uint64_t> busy_ns_{0};
+            std::atomic<uint64_t> idle_ns_{0};
+            // Start of the current busy or idle stretch, lets metrics() include it.
+            std::atomic<uint64_t> since_ns_{0};
+            std::atomic<bool> idle_{false};
+            std::array<std::atomic<uint64_t>, queue_wait_buckets> queue_wait_{};
+        };
+
+        static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) noexcept
+        {
+            counter.store(counter.load(std::memory_order::relaxed) + amount, std::memory_order::relaxed);
+        }
+
+        static uint64_t now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+        }
+
+        queued_handle stamp(std::coroutine_handle<> handle) const noexcept
+        {
+            return queued_handle{reinterpret_cast<uintptr_t>(handle.address()), opts_.measure_queue_wait ? now_ns() : 0};
+        }
+
+        queued_handle stamp(execute_node* node) const noexcept
+        {
+            return queued_handle{reinterpret_cast<uintptr_t>(node) | execute_tag, opts_.measure_queue_wait ? now_ns() : 0};
+        }
+
+        // Resumes the coroutine or invokes the execute() callable behind item.
+        void run(const queued_handle& item) noexcept;
+
+        struct worker
+        {
+            worker(ThreadPool& tp, thread_info info, std::size_t node_idx) noexcept
+                : thread_pool_(tp)
+                , info_(info)
+                , node_idx_(node_idx)
+                , rng_state_(static_cast<uint32_t>(info.idx) * 2654435761u + 1)
+            {
+
+            }
+
+            ThreadPool& thread_pool_;
+            thread_info info_;
+            // Dense index into injection_ and node_workers_.
+            std::size_t node_idx_;
+            uint32_t rng_state_;
+            std::array<detail::work_stealing_queue<queued_handle>, priority_count> local_queues_;
+            // Remaining weighted round robin turns per class, refilled from options::priority_weights.
+            std::array<uint32_t, priority_count> credits_{};
+
+            // Owner only, never stolen and not counted by queue_size().
+            std::optional<queued_handle> lifo_slot_{};
+            std::size_t lifo_cls_{0};
+            // Handles run from the slot in a row, capped by options::lifo_budget.
+            uint32_t lifo_runs_{0};
+
+            // Recently freed execute() nodes, owner only.
+            std::vector<execute_node*> node_cache_{};
+
+            // 0 while parked, set to 1 by whoever unparks this worker.
+            alignas(64) std::atomic<uint32_t> futex_word_{0};
+
+            worker_counters counters_{};
+
+            // Whether a thread currently runs this worker, guarded by elastic_mtx_.
+            bool running_{false};
+        };
+
         options opts_;
+        std::vector<std::unique_ptr<worker>> workers_;
+        // One slot per worker up to max_thread_count, spare slots start empty.
         std::vector<std::jthread> threads_;
-        std::mutex wait_mtx_;
-        std::condition_variable_any wait_cv_;
-        std::deque<std::coroutine_handle<>> queue_;
+        std::mutex elastic_mtx_;
+        std::atomic<uint32_t> live_{0};
+        std::atomic<uint32_t> blocked_{0};
+
+        // Injection queues for handles submitted from outside the pool, one per node.
+        struct injection_queue
+        {
+            using ring_type = detail::mpmc_ring<queued_handle>;
+
+            explicit injection_queue(std::size_t capacity)
+            {
+                for (auto& ring : rings_)
+                {
+                    ring = std::make_unique<ring_type>(capacity);
+                }
+            }
+
+            std::array<std::unique_ptr<ring_type>, priority_count> rings_;
+
+            // Slow path once a ring is full, producers keep using it until it
+            // has drained so submissions stay in FIFO order.
+            std::mutex overflow_mtx_;
+            std::array<std::deque<queued_handle>, priority_count> overflow_;
+            std::array<std::atomic<std::size_t>, priority_count> overflowed_{};
+        };
+        std::vector<std::unique_ptr<injection_queue>> injection_;
+        std::vector<std::vector<worker*>> node_workers_;
+        // Maps a CPU id to its index in injection_, empty when placement is NONE.
+        std::vector<std::size_t> cpu_to_node_;
+
+        // Parked workers, most recently parked last so wakeups hit a warm cache.
+        std::mutex idle_mtx_;
+        std::vector<worker*> idle_workers_;
+
+        static thread_local worker* current_worker_;
+
+        worker* local_worker() const noexcept
+        {
+            return (current_worker_ != nullptr && &current_worker_->thread_pool_ == this) ? current_worker_ : nullptr;
+        }
+
+        void place_workers();
+
+        /*
+         * Starts the thread of a free worker slot, called with elastic_mtx_
+         * held. A failure rethrows for core slots, spares return false so
+         * compensate() degrades instead.
+         */
+        bool start_worker(std::size_t idx);
+
+        // Starts spares while fewer than thread_count workers are runnable.
+        void compensate() noexcept;
+
+        injection_queue& caller_injection_queue() noexcept;
+
+        void inject(injection_queue& iq, std::size_t cls, queued_handle item);
+
+        // Publishes the count non null handles with a single ring reservation.
+        template <typename range_type>
+        void inject(injection_queue& iq, std::size_t cls, const range_type& handles, std::size_t count)
+        {
+            auto& ring = *iq.rings_[cls];
+            auto it = std::begin(handles);
+            uint64_t pos{0};
+            std::size_t reserved{0};
+
+            if (iq.overflowed_[cls].load(std::memory_order::acquire) == 0)
+            {
+                reserved = ring.try_reserve(count, pos);
+            }
+
+            for (std::size_t i = 0; i < reserved; ++it)
+            {
+                if (*it != nullptr) [[likely]]
+                {
+                    ring.publish(pos + i, stamp(*it));
+                    ++i;
+                }
+            }
+
+            if (reserved < count)
+            {
+                std::scoped_lock lk{iq.overflow_mtx_};
+                for (; it != std::end(handles); ++it)
+                {
+                    if (*it != nullptr) [[likely]]
+                    {
+                        iq.overflow_[cls].emplace_back(stamp(*it));
+                    }
+                }
+                iq.overflowed_[cls].fetch_add(count - reserved, std::memory_order::release);
+            }
+        }
+
+        void executor(std::stop_token st, worker& w);
+
+        // Closes the worker's current busy or idle stretch and starts the other one.
+        void account(worker& w, bool idle) noexcept;
+
+        std::size_t queued(std::size_t cls) const noexcept;
+
+        bool has_queued() const noexcept;
+
+        std::optional<queued_handle> next_handle(worker& w) noexcept;
+
+        // Moves the LIFO slot occupant to the worker's queue so peers can take it.
+        void flush_lifo_slot(worker& w) noexcept;
+
+        std::optional<queued_handle> take(worker& w, std::size_t cls) noexcept;
+
+        std::optional<queued_handle> take_injected(injection_queue& iq, std::size_t cls) noexcept;
+
+        std::optional<queued_handle> steal(worker& w) noexcept;
+
+        // Both return false when the worker retired and its thread should exit.
+        bool wait_for_work(std::stop_token& st, worker& w);
+
+        bool park(std::stop_token& st, worker& w);
+
+        // Called by a parked worker once spare_idle_timeout expired, only spares retire.
+        bool try_retire(worker& w) noexcept;
+
+        // Wakes up to count parked workers, never more than are parked.
+        void notify_workers(std::size_t count = 1) noexcept;
+
+        void unpark_all() noexcept;
+
+        void _schedule(std::coroutine_handle<> handle, Priority priority, bool lifo = false) noexcept;
+
+        // Pushes item to the caller's local queue, or injects it, and wakes a worker.
+        void enqueue(queued_handle item, std::size_t cls) noexcept;
+
+        /*
+         * execute() nodes come from the calling worker's cache, then from the
+         * shared free ring backed by a preallocated slab, then from the heap.
+         */
+        execute_node* acquire_node();
+
+        void release_node(execute_node* node) noexcept;
+
+        bool slab_node(const execute_node* node) const noexcept
+        {
+            return node >= execute_slab_.get() && node < execute_slab_.get() + opts_.execute_nodes;
+        }
+
+        std::unique_ptr<execute_node[]> execute_slab_;
+        std::unique_ptr<detail::mpmc_ring<execute_node*>> free_nodes_;
+
+        bool above_high_water() const noexcept
+        {
+            return opts_.high_water_mark > 0 && queue_size() >= opts_.high_water_mark;
+        }
+
+        // Parks op's coroutine instead of queueing it while above the high water mark.
+        bool throttle(operation& op) noexcept;
+
+        // Requeues throttled coroutines until the high water mark is reached again.
+        void release_throttled() noexcept;
 
-        void executor(std::stop_token, std::size_t idx);
+        // Every dequeue goes through here so throttled coroutines get released.
+        void dequeued() noexcept;
 
-        void _schedule(std::coroutine_handle<> handle) noexcept;
+        // FIFO of parked awaiters linked through operation::next_.
+        std::mutex throttle_mtx_;
+        operation* throttled_head_{nullptr};
+        operation* throttled_tail_{nullptr};
+        std::atomic<std::size_t> throttled_count_{0};
 
         std::atomic<std::size_t> size_{0};
+        alignas(64) std::atomic<std::size_t> sleeping_{0};
         std::atomic<bool> shutdown_requested_{false};
 };
 
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <concepts/awaitable.h>
+#include <detail/stop_token.h>
 #include <detail/void_value.h>
 
 #include <atomic>
 #include <coroutine>
 #include <ranges>
+#include <stop_token>
 #include <tuple>
 #include <vector>
 
@@ -126,64 +128,45 @@ class when_all_ready_awaitable<std::tuple<task_types...>>
         when_all_ready_awaitable& operator=(const when_all_ready_awaitable&) = delete;
         when_all_ready_awaitable& operator=(when_all_ready_awaitable&&) = delete;
         
-        auto operator co_await() & noexcept
+        struct awaiter_base
         {
-            struct awaiter
+            bool await_ready() const noexcept
             {
-                explicit awaiter(when_all_ready_awaitable& awaitable) noexcept
-                    : awaitable_(awaitable)
-                {
-                
-                }
+                return awaitable_.is_ready();
+            }
 
-                bool await_ready() const noexcept
-                {
-                    return awaitable_.is_ready();
-                }
+            // Every child runs with the awaiting coroutine's stop_token.
+            template <typename awaiting_promise>
+            bool await_suspend(std::coroutine_handle<awaiting_promise> awaiting_coroutine) noexcept
+            {
+                return awaitable_.try_await(awaiting_coroutine, detail::stop_token_of(awaiting_coroutine));
+            }
 
-                bool await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
-                {
-                    return awaitable_.try_await(awaiting_coroutine);
-                }
+            when_all_ready_awaitable& awaitable_;
+        };
 
+        auto operator co_await() & noexcept
+        {
+            struct awaiter : awaiter_base
+            {
                 std::tuple<task_types...>& await_resume()
                 {
-                    return awaitable_.tasks_;
+                    return this->awaitable_.tasks_;
                 }
-                private:
-                    when_all_ready_awaitable& awaitable_;
             };
-            return awaiter{*this};
+            return awaiter{{*this}};
         }
 
         auto operator co_await() && noexcept
         {
-            struct awaiter
+            struct awaiter : awaiter_base
             {
-                explicit awaiter(when_all_ready_awaitable& awaitable) noexcept
-                    : awaitable_(awaitable)
-                {
-                
-                }
-
-                bool await_ready() const noexcept
-                {
-                    return awaitable_.is_ready();
-                }
-
-                bool await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
-                {
-                    return awaitable_.try_await(awaiting_coroutine);
-                }
-
                 auto await_resume() noexcept -> std::tuple<task_types...>&&
                 {
-                    return std::move(awaitable_.tasks_);
+                    return std::move(this->awaitable_.tasks_);
                 }
-                private:
-                    when_all_ready_awaitable& awaitable_;
             };
-            return awaiter{*this};
+            return awaiter{{*this}};
         }
 
     private:
@@ -195,11 +178,11 @@ class when_all_ready_awaitable<std::tuple<task_types...>>
             return latch_.is_ready();
         }
 
-        bool try_await(std::coroutine_handle<> awaiting_coroutine) noexcept
+        bool try_await(std::coroutine_handle<> awaiting_coroutine, const std::stop_token& token) noexcept
         {
-            std::apply([this](auto&&... tasks)
+            std::apply([this, &token](auto&&... tasks)
 												{ 
-													((tasks.start(latch_)), ...); 
+													((tasks.start(latch_, token)), ...); 
 												}, tasks_);
 
             return latch_.try_await(awaiting_coroutine);
@@ -229,67 +212,46 @@ class when_all_ready_awaitable
         when_all_ready_awaitable& operator=(const when_all_ready_awaitable&)= delete;
         when_all_ready_awaitable& operator=(when_all_ready_awaitable&) = delete;
 
-        auto operator co_await() & noexcept
+        struct awaiter_base
         {
-            struct awaiter
+            bool await_ready() const noexcept
             {
-                awaiter(when_all_ready_awaitable& awaitable)
-                    : awaitable_(awaitable)
-                {
-                
-                }
+                return awaitable_.is_ready();
+            }
 
-                bool await_ready() const noexcept
-                {
-                    return awaitable_.is_ready();
-                }
+            // Every child runs with the awaiting coroutine's stop_token.
+            template <typename awaiting_promise>
+            bool await_suspend(std::coroutine_handle<awaiting_promise> awaiting_coroutine) noexcept
+            {
+                return awaitable_.try_await(awaiting_coroutine, detail::stop_token_of(awaiting_coroutine));
+            }
 
-                bool await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
-                {
-                    return awaitable_.try_await(awaiting_coroutine);
-                }
+            when_all_ready_awaitable& awaitable_;
+        };
 
+        auto operator co_await() & noexcept
+        {
+            struct awaiter : awaiter_base
+            {
                 task_container_type& await_resume()
                 {
-                    return awaitable_.tasks_;
+                    return this->awaitable_.tasks_;
                 }
-
-                private:
-                    when_all_ready_awaitable& awaitable_;
             };
-            return awaiter{*this};
+            return awaiter{{*this}};
         }
 
         auto operator co_await() && noexcept
         {
-            struct awaiter
+            struct awaiter : awaiter_base
             {
-                awaiter(when_all_ready_awaitable& awaitable)
-                    : awaitable_(awaitable)
-                {
-
-                }
-
-                bool await_ready() const noexcept
-                {
-                    return awaitable_.is_ready();
-                }
-
-                bool await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
-                {
-                    return awaitable_.try_await(awaiting_coroutine);
-                }
-
                 task_container_type&& await_resume() noexcept
                 {
-                    return std::move(awaitable_.tasks_);
+                    return std::move(this->awaitable_.tasks_);
                 }
-
-                private:
-                    when_all_ready_awaitable& awaitable_;
             };
 
-            return awaiter{*this};
+            return awaiter{{*this}};
         }
         
     private:
@@ -301,11 +263,11 @@ class when_all_ready_awaitable
             return latch_.is_ready();
         }
 
-        bool try_await(std::coroutine_handle<> awaiting_coroutine) noexcept
+        bool try_await(std::coroutine_handle<> awaiting_coroutine, const std::stop_token& token) noexcept
         {
         	for (auto& task : tasks_)
 					{
-						task.start(latch_);
+						task.start(latch_, token);
 					}
 					return latch_.try_await(awaiting_coroutine);
 				}
@@ -366,12 +328,18 @@ class when_all_task_promise
             return final_suspend();
         }
 
-        void start(when_all_latch& latch) noexcept
+        void start(when_all_latch& latch, const std::stop_token& token) noexcept
         {
             latch_ = &latch;
+            stop_token_ = token;
             coroutine_handle_type::from_promise(*this).resume();
         }
 
+        std::stop_token get_stop_token() const noexcept
+        {
+            return stop_token_;
+        }
+
         return_type& return_value()
         {
             if (p_exception_)
@@ -385,6 +353,7 @@ class when_all_task_promise
         when_all_latch* latch_{nullptr};
         std::exception_ptr p_exception_;
         std::add_pointer_t<return_type> return_value_;
+        std::stop_token stop_token_{};
 };
 
 template <>
@@ -449,15 +418,22 @@ class when_all_task_promise<void>
         }
     }
 
-    void start(when_all_latch& latch)
+    void start(when_all_latch& latch, const std::stop_token& token)
     {
         latch_ = &latch;
+        stop_token_ = token;
         coroutine_handle_type::from_promise(*this).resume();
     }
 
+    std::stop_token get_stop_token() const noexcept
+    {
+        return stop_token_;
+    }
+
     private:
         when_all_latch* latch_{nullptr};
         std::exception_ptr p_exception_;
+        std::stop_token stop_token_{};
 };
 
 template <typename return_type>
@@ -536,9 +512,9 @@ class when_all_task
         }
 
     private:
-        void start(when_all_latch& latch) noexcept
+        void start(when_all_latch& latch, const std::stop_token& token) noexcept
         {
-            coroutine_.promise().start(latch);
+            coroutine_.promise().start(latch, token);
         }
 
         coroutine_handle_type coroutine_;
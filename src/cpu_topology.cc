@@ -0,0 +1,149 @@
+#include <detail/cpu_topology.h>
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace coro::detail
+{
+
+cpu_topology cpu_topology::discover()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        for (uint32_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+        {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+
+    cpu_topology topology{};
+
+    std::error_code ec;
+    const std::filesystem::path root{"/sys/devices/system/node"};
+    for (const auto& entry : std::filesystem::directory_iterator{root, ec})
+    {
+        const auto name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0)
+        {
+            continue;
+        }
+
+        uint32_t id{0};
+        auto [ptr, err] = std::from_chars(name.data() + 4, name.data() + name.size(), id);
+        if (err != std::errc{} || ptr != name.data() + name.size())
+        {
+            continue;
+        }
+
+        std::ifstream in{entry.path() / "cpulist"};
+        std::string list;
+        std::getline(in, list);
+
+        node n{.id = id, .cpus = {}};
+        for (uint32_t cpu : parse_cpu_list(list))
+        {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+            {
+                n.cpus.push_back(cpu);
+            }
+        }
+
+        if (!n.cpus.empty())
+        {
+            topology.nodes.emplace_back(std::move(n));
+        }
+    }
+
+    if (topology.nodes.empty())
+    {
+        node n{.id = 0, .cpus = {}};
+        for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                n.cpus.push_back(cpu);
+            }
+        }
+        topology.nodes.emplace_back(std::move(n));
+    }
+
+    std::sort(topology.nodes.begin(), topology.nodes.end(), [](const node& a, const node& b)
+            {
+                return a.id < b.id;
+            });
+
+    return topology;
+}
+
+std::vector<uint32_t> cpu_topology::parse_cpu_list(std::string_view list)
+{
+    std::vector<uint32_t> cpus;
+
+    while (!list.empty())
+    {
+        auto comma = list.find(',');
+        auto range = list.substr(0, comma);
+        list = (comma == std::string_view::npos) ? std::string_view{} : list.substr(comma + 1);
+
+        while (!range.empty() && (range.back() == '\n' || range.back() == ' '))
+        {
+            range.remove_suffix(1);
+        }
+
+        uint32_t first{0};
+        auto [ptr, err] = std::from_chars(range.data(), range.data() + range.size(), first);
+        if (err != std::errc{})
+        {
+            continue;
+        }
+
+        uint32_t last{first};
+        if (ptr != range.data() + range.size() && *ptr == '-')
+        {
+            std::from_chars(ptr + 1, range.data() + range.size(), last);
+        }
+
+        for (uint32_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+int32_t cpu_topology::node_of(uint32_t cpu) const noexcept
+{
+    for (std::size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (std::find(nodes[i].cpus.begin(), nodes[i].cpus.end(), cpu) != nodes[i].cpus.end())
+        {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+bool pin_current_thread(uint32_t cpu) noexcept
+{
+    if (cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+} // namespace coro::detail
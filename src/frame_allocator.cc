@@ -0,0 +1,319 @@
+#include <detail/frame_allocator.h>
+#include <detail/mpsc_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace coro::detail
+{
+namespace
+{
+using frame_header = frame_allocator::frame_header;
+static_assert(sizeof(frame_header) == 16, "frames keep the default new alignment");
+
+// A free frame, linked through its payload.
+struct free_block
+{
+    free_block* next_{nullptr};
+};
+
+/*
+ * One thread's free lists. Only the owning thread touches the lists, other
+ * threads push to remote_. A cache outlives its thread, frames it handed out
+ * may still be freed later, and is adopted by the next thread that starts
+ * allocating.
+ */
+struct thread_cache
+{
+    std::array<free_block*, frame_allocator::class_count> free_{};
+    std::array<uint32_t, frame_allocator::class_count> cached_{};
+    mpsc_queue<free_block> remote_{};
+
+    // Single writer counters, bumped with a plain load/store instead of an RMW.
+    std::atomic<uint64_t> allocations_{0};
+    std::atomic<uint64_t> deallocations_{0};
+    std::atomic<uint64_t> cache_hits_{0};
+    std::atomic<uint64_t> heap_allocations_{0};
+    std::atomic<uint64_t> oversized_{0};
+    std::atomic<uint64_t> remote_frees_{0};
+    std::atomic<uint64_t> cached_bytes_{0};
+    std::array<std::atomic<uint64_t>, frame_allocator::class_count> allocations_per_class_{};
+};
+
+struct cache_registry
+{
+    std::mutex mtx_{};
+    std::vector<thread_cache*> caches_{};
+    std::vector<thread_cache*> orphans_{};
+};
+
+// Never destroyed, frames may be freed during static destruction.
+cache_registry& registry()
+{
+    static auto* instance = new cache_registry{};
+    return *instance;
+}
+
+void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) noexcept
+{
+    counter.store(counter.load(std::memory_order::relaxed) + amount, std::memory_order::relaxed);
+}
+
+void drop(std::atomic<uint64_t>& counter, uint64_t amount) noexcept
+{
+    counter.store(counter.load(std::memory_order::relaxed) - amount, std::memory_order::relaxed);
+}
+
+constexpr std::size_t class_bytes(uint32_t size_class) noexcept
+{
+    return (size_class + 1) * frame_allocator::class_granularity;
+}
+
+frame_header* header_of(void* payload) noexcept
+{
+    return static_cast<frame_header*>(payload) - 1;
+}
+
+void push_local(thread_cache& cache, free_block* block, bool capped) noexcept
+{
+    auto* header = header_of(block);
+    const auto size_class = static_cast<uint32_t>(header->info_);
+    if (capped && (cache.cached_[size_class] + 1) * class_bytes(size_class) > frame_allocator::max_cached_bytes)
+    {
+        std::free(header);
+        return;
+    }
+
+    block->next_ = cache.free_[size_class];
+    cache.free_[size_class] = block;
+    ++cache.cached_[size_class];
+    bump(cache.cached_bytes_, class_bytes(size_class));
+}
+
+// Remote frees are kept whatever the cap, they are only drained when a list
+// ran dry and never exceed what this thread had allocated.
+void drain_remote(thread_cache& cache) noexcept
+{
+    for (auto* block = cache.remote_.take_all(); block != nullptr;)
+    {
+        auto* next = block->next_;
+        push_local(cache, block, false);
+        block = next;
+    }
+}
+
+// Hands the cache back for adoption once its thread is gone.
+void retire(thread_cache& cache) noexcept
+{
+    drain_remote(cache);
+    for (std::size_t i = 0; i < frame_allocator::class_count; ++i)
+    {
+        while (auto* block = cache.free_[i])
+        {
+            cache.free_[i] = block->next_;
+            std::free(header_of(block));
+        }
+        cache.cached_[i] = 0;
+    }
+    cache.cached_bytes_.store(0, std::memory_order::relaxed);
+
+    auto& reg = registry();
+    std::scoped_lock lk{reg.mtx_};
+    reg.orphans_.emplace_back(&cache);
+}
+
+thread_local thread_cache* current_cache{nullptr};
+thread_local bool thread_exiting{false};
+
+struct cache_guard
+{
+    ~cache_guard()
+    {
+        thread_exiting = true;
+        if (auto* cache = std::exchange(current_cache, nullptr); cache != nullptr)
+        {
+            retire(*cache);
+        }
+    }
+};
+
+// Frames that bypass the caches keep a replaced global operator new in charge.
+frame_header* allocate_heap(std::size_t size)
+{
+    auto* header = static_cast<frame_header*>(::operator new(sizeof(frame_header) + size));
+    header->owner_ = nullptr;
+    header->info_ = 0;
+    return header;
+}
+
+// The calling thread's cache, nullptr once the thread is exiting.
+thread_cache* local_cache()
+{
+    if (current_cache != nullptr) [[likely]]
+    {
+        return current_cache;
+    }
+
+    if (thread_exiting)
+    {
+        return nullptr;
+    }
+
+    {
+        auto& reg = registry();
+        std::scoped_lock lk{reg.mtx_};
+        if (!reg.orphans_.empty())
+        {
+            current_cache = reg.orphans_.back();
+            reg.orphans_.pop_back();
+        }
+        else
+        {
+            current_cache = new thread_cache{};
+            reg.caches_.emplace_back(current_cache);
+        }
+    }
+
+    // Constructed on first use, its destructor runs when the thread exits.
+    static thread_local cache_guard guard{};
+    (void)guard;
+    return current_cache;
+}
+
+} // namespace
+
+void* frame_allocator::allocate(std::size_t size)
+{
+    auto* cache = local_cache();
+
+    if (size > max_class_size || cache == nullptr) [[unlikely]]
+    {
+        auto* header = allocate_heap(size);
+
+        if (cache != nullptr)
+        {
+            bump(cache->allocations_);
+            bump(cache->oversized_);
+        }
+        return header + 1;
+    }
+
+    const auto size_class = static_cast<uint32_t>((std::max<std::size_t>(size, 1) - 1) / class_granularity);
+
+    auto* block = cache->free_[size_class];
+    if (block == nullptr && !cache->remote_.empty())
+    {
+        drain_remote(*cache);
+        block = cache->free_[size_class];
+    }
+
+    frame_header* header{nullptr};
+    if (block != nullptr)
+    {
+        cache->free_[size_class] = block->next_;
+        --cache->cached_[size_class];
+        drop(cache->cached_bytes_, class_bytes(size_class));
+        bump(cache->cache_hits_);
+        header = header_of(block);
+    }
+    else
+    {
+        header = static_cast<frame_header*>(std::malloc(sizeof(frame_header) + class_bytes(size_class)));
+        if (header == nullptr)
+        {
+            throw std::bad_alloc{};
+        }
+        bump(cache->heap_allocations_);
+    }
+
+    header->owner_ = cache;
+    header->info_ = size_class;
+    bump(cache->allocations_);
+    bump(cache->allocations_per_class_[size_class]);
+    return header + 1;
+}
+
+void* frame_allocator::allocate_unpooled(std::size_t size)
+{
+    return allocate_heap(size) + 1;
+}
+
+void frame_allocator::deallocate(void* ptr, std::size_t size) noexcept
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    auto* header = header_of(ptr);
+    auto* owner = static_cast<thread_cache*>(header->owner_);
+    if (owner == nullptr && header->info_ != 0)
+    {
+        // Back to the allocator the coroutine was called with.
+        reinterpret_cast<void (*)(frame_header*, std::size_t) noexcept>(header->info_)(header, size);
+        return;
+    }
+
+    if (owner == nullptr)
+    {
+        // Counted where a cache exists, without CORO_FRAME_ALLOCATOR none does.
+        if (current_cache != nullptr)
+        {
+            bump(current_cache->deallocations_);
+        }
+        ::operator delete(header, sizeof(frame_header) + size);
+        return;
+    }
+
+    auto* cache = local_cache();
+
+    if (cache != nullptr)
+    {
+        bump(cache->deallocations_);
+    }
+
+    auto* block = new (ptr) free_block{};
+    if (owner == cache)
+    {
+        push_local(*cache, block, true);
+        return;
+    }
+
+    // The owner drains it once one of its lists runs dry.
+    if (cache != nullptr)
+    {
+        bump(cache->remote_frees_);
+    }
+    owner->remote_.push(*block);
+}
+
+auto frame_allocator::metrics() -> metrics_snapshot
+{
+    metrics_snapshot snapshot{};
+
+    auto& reg = registry();
+    std::scoped_lock lk{reg.mtx_};
+    for (const auto* cache : reg.caches_)
+    {
+        snapshot.allocations += cache->allocations_.load(std::memory_order::relaxed);
+        snapshot.deallocations += cache->deallocations_.load(std::memory_order::relaxed);
+        snapshot.cache_hits += cache->cache_hits_.load(std::memory_order::relaxed);
+        snapshot.heap_allocations += cache->heap_allocations_.load(std::memory_order::relaxed);
+        snapshot.oversized += cache->oversized_.load(std::memory_order::relaxed);
+        snapshot.remote_frees += cache->remote_frees_.load(std::memory_order::relaxed);
+        snapshot.cached_bytes += cache->cached_bytes_.load(std::memory_order::relaxed);
+        for (std::size_t i = 0; i < class_count; ++i)
+        {
+            snapshot.allocations_per_class[i] += cache->allocations_per_class_[i].load(std::memory_order::relaxed);
+        }
+    }
+
+    return snapshot;
+}
+
+} // namespace coro::detail
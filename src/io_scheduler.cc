@@ -1,51 +1,98 @@
 #include <io_scheduler.h>
+#include <detail/futex.h>
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cerrno>
 #include <cstring>
+#include <memory>
 #include <optional>
+#include <string>
+#include <utility>
 
+#include <fcntl.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 using namespace std::chrono_literals;
 
 namespace coro
 {
+thread_local IOScheduler::reactor* IOScheduler::current_reactor_{nullptr};
+
 IOScheduler::IOScheduler(options opts)
     : opts_(std::move(opts))
-    , epoll_fd_(epoll_create1(EPOLL_CLOEXEC))
     , shutdown_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
-    , timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
-    , schedule_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
-    , owned_tasks_(new coro::task_container<coro::io_scheduler>(*this))
+    , owned_tasks_(new coro::TaskContainer<coro::IOScheduler>(*this))
 {
-    if (opts.execution_strategy == ExecutionStrategy::PROCESS_TASKS_ON_THREAD_POOL)
+    if (opts_.reactor_count == 0)
+    {
+        opts_.reactor_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    opts_.max_events = std::max<std::size_t>(opts_.max_events, 1);
+
+    if (opts_.reactor_count > 1 && opts_.thread_strategy == ThreadStrategy::MANUAL)
+    {
+        delete static_cast<coro::TaskContainer<coro::IOScheduler>*>(owned_tasks_);
+        close(shutdown_fd_);
+        throw std::runtime_error{"IOScheduler with more than one reactor requires ThreadStrategy::SPAWN"};
+    }
+
+    // Adaptive mode offloads to the pool too.
+    if (opts_.execution_strategy != ExecutionStrategy::PROCESS_TASKS_INLINE)
     {
         thread_pool_ = std::make_unique<ThreadPool>(std::move(opts_.pool));
     }
 
-    epoll_event e{};
-    
-    e.events = EPOLLIN;
-    e.data.ptr = const_cast<void*>(shutdown_ptr_);
-    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, shutdown_fd_, &e);
+    reactors_.reserve(opts_.reactor_count);
+    for (std::size_t i = 0; i < opts_.reactor_count; ++i)
+    {
+        auto r = std::make_unique<reactor>();
+        r->scheduler_ = this;
+        r->timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        r->schedule_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        r->events_.resize(opts_.max_events);
+
+        if (opts_.backend == Backend::IO_URING)
+        {
+            r->uring_ = detail::io_uring::create(opts_.io_uring_entries);
+        }
+
+        // Registered fds need multishot polls (5.13), io_uring reactors
+        // without them keep those in an epoll fd they poll instead.
+        if (r->uring_ == nullptr || !r->uring_->multishot_poll())
+        {
+            r->epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        }
 
-    e.data.ptr = const_cast<void>(timer_ptr_);
-    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &e);
+        // Every reactor watches the same shutdown eventfd.
+        arm_wakeup(*r, shutdown_fd_, shutdown_ptr_);
+        arm_wakeup(*r, r->timer_fd_, timer_ptr_);
+        arm_wakeup(*r, r->schedule_fd_, schedule_ptr_);
+        if (r->uring_ != nullptr && r->epoll_fd_ != -1)
+        {
+            arm_wakeup(*r, r->epoll_fd_, registrations_ptr_);
+        }
 
-    e.data.ptr = const_cast<void*>(schedule_ptr_);
-    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, schedule_fd_, &e);
+        reactors_.emplace_back(std::move(r));
+    }
 
     if (opts_.thread_strategy == ThreadStrategy::SPAWN)
     {
-        io_thread_ = std::thread([this]()
-                {
-                    process_events_dedicated_thread();
-                });
+        for (auto& r : reactors_)
+        {
+            r->io_thread_ = std::thread([this, &r = *r]()
+                    {
+                        process_events_dedicated_thread(r);
+                    });
+        }
     }
 }
 
@@ -53,51 +100,1618 @@ IOScheduler::~IOScheduler()
 {
     shutdown();
 
-    if (io_thread_.joinable())
+    for (auto& r : reactors_)
+    {
+        if (r->io_thread_.joinable())
+        {
+            r->io_thread_.join();
+        }
+
+        r->uring_.reset();
+
+        if (r->epoll_fd_ != -1)
+        {
+            close(r->epoll_fd_);
+            r->epoll_fd_ = -1;
+        }
+
+        if (r->timer_fd_ != -1)
+        {
+            close(r->timer_fd_);
+            r->timer_fd_ = -1;
+        }
+
+        if (r->schedule_fd_ != -1)
+        {
+            close(r->schedule_fd_);
+            r->schedule_fd_ = -1;
+        }
+
+        // The backend is gone, nothing can report on these anymore.
+        for (auto* reg : r->retired_)
+        {
+            delete reg;
+        }
+        r->retired_.clear();
+    }
+
+    if (shutdown_fd_ != -1)
+    {
+        close(shutdown_fd_);
+        shutdown_fd_ = -1;
+    }
+
+    if (owned_tasks_ != nullptr)
     {
-        io_thread_.join();
+        delete static_cast<coro::TaskContainer<coro::IOScheduler>*>(owned_tasks_);
+        owned_tasks_ = nullptr;
     }
+}
+
+std::size_t IOScheduler::process_events(std::chrono::milliseconds timeout)
+{
+    process_events_manual(*reactors_.front(), timeout);
+    return size();
+}
+
+auto IOScheduler::next_deadline() const -> std::optional<time_point>
+{
+    auto& r = *reactors_.front();
+    std::scoped_lock lk{r.timed_events_mtx_};
+    return r.timed_events_.next_deadline();
+}
+
+auto IOScheduler::schedule_after(std::chrono::milliseconds amount, std::chrono::milliseconds slack)
+    -> timer_operation
+{
+    return yield_for(amount, slack);
+}
+
+auto IOScheduler::schedule_at(time_point time, std::chrono::milliseconds slack) -> timer_operation
+{
+    return yield_until(time, slack);
+}
 
-    if (epoll_fd_ != -1)
+auto IOScheduler::yield_for(std::chrono::milliseconds amount, std::chrono::milliseconds slack) -> timer_operation
+{
+    if (amount <= 0ms)
     {
-        close(epoll_fd_);
-        epoll_fd_ = -1;
+        return timer_operation{*this, time_point{}, slack, true};
     }
-     
-    if (timer_fd_ != -1)
+    return timer_operation{*this, clock::now() + amount, slack, false};
+}
+
+auto IOScheduler::yield_until(time_point time, std::chrono::milliseconds slack) -> timer_operation
+{
+    return timer_operation{*this, time, slack, time <= clock::now()};
+}
+
+bool IOScheduler::timer_operation::suspend(std::coroutine_handle<> awaiting_coroutine, const std::stop_token& token) noexcept
+{
+    if (expired_)
     {
-        close(timer_fd_);
-        timer_fd_ = -1;
+        pi_.poll_status_ = PollStatus::TIMEOUT;
+        if (scheduler_.queues_inline())
+        {
+            node_.handle_ = awaiting_coroutine;
+            scheduler_.schedule_inline(scheduler_.local_reactor(), node_);
+        }
+        else
+        {
+            scheduler_.thread_pool_->resume(awaiting_coroutine);
+        }
+        return true;
     }
-     
-    if (schedule_fd_ != -1)
+
+    if (token.stop_requested())
     {
-        close(schedule_fd_);
-        schedule_fd_ = -1;
+        pi_.poll_status_ = PollStatus::CANCELLED;
+        return false;
     }
-  
-    if (owned_tasks != nullptr)
+
+    // Yield/timeout waits are considered live in the scheduler and must be
+    // accounted for, schedule() accounts for itself.
+    scheduler_.size_.fetch_add(1, std::memory_order::release);
+    suspended_ = true;
+
+    // A yield has no fd event that could trigger, it always waits for the
+    // timeout or a stop request. The io thread waits for publish(), nothing
+    // here is touched after it.
+    auto& r = scheduler_.local_reactor();
+    pi_.awaiting_coroutine_ = awaiting_coroutine;
+    scheduler_.add_timer_token(r, deadline_, pi_, slack_);
+    scheduler_.watch_stop(r, pi_, token, stop_callback_);
+    publish(pi_);
+    return true;
+}
+
+PollStatus IOScheduler::timer_operation::await_resume() noexcept
+{
+    if (suspended_)
     {
-        delete static_cast<coro::task_container<coro::IOScheduler>*>(owned_tasks_);
-        owned_tasks_ = nullptr;
+        scheduler_.size_.fetch_sub(1, std::memory_order::release);
     }
+    return pi_.poll_status_;
 }
 
-std::size_t IOScheduler::process_events(std::chrono::milliseconds timeout)
+auto IOScheduler::poll(fd_t fd, coro::PollOption op, std::chrono::milliseconds timeout) -> poll_operation
 {
-    process_events_manual(timeout);
-    return size();
+    return poll_operation{*this, *reactors_[reactor_for(fd)], fd, op, timeout, nullptr};
+}
+
+auto IOScheduler::poll(fd_t fd, coro::PollOption op, std::chrono::milliseconds timeout, std::size_t reactor)
+    -> poll_operation
+{
+    return poll_operation{*this, *reactors_[reactor % reactors_.size()], fd, op, timeout, nullptr};
+}
+
+IOScheduler::registered_fd::registered_fd(IOScheduler& scheduler, reactor& r, detail::fd_registration& reg) noexcept
+    : scheduler_(&scheduler)
+    , reactor_(&r)
+    , reg_(&reg)
+{
+
+}
+
+IOScheduler::registered_fd::registered_fd(registered_fd&& other) noexcept
+    : scheduler_(std::exchange(other.scheduler_, nullptr))
+    , reactor_(std::exchange(other.reactor_, nullptr))
+    , reg_(std::exchange(other.reg_, nullptr))
+{
+
+}
+
+auto IOScheduler::registered_fd::operator=(registered_fd&& other) noexcept -> registered_fd&
+{
+    if (std::addressof(other) != this)
+    {
+        if (reg_ != nullptr)
+        {
+            scheduler_->unregister_fd(*reactor_, *reg_);
+        }
+
+        scheduler_ = std::exchange(other.scheduler_, nullptr);
+        reactor_ = std::exchange(other.reactor_, nullptr);
+        reg_ = std::exchange(other.reg_, nullptr);
+    }
+    return *this;
+}
+
+IOScheduler::registered_fd::~registered_fd()
+{
+    if (reg_ != nullptr)
+    {
+        scheduler_->unregister_fd(*reactor_, *reg_);
+    }
+}
+
+auto IOScheduler::register_fd(fd_t fd, coro::PollOption interest) -> registered_fd
+{
+    return register_fd(fd, interest, reactor_for(fd));
+}
+
+auto IOScheduler::register_fd(fd_t fd, coro::PollOption interest, std::size_t reactor) -> registered_fd
+{
+    auto& r = *reactors_[reactor % reactors_.size()];
+    auto* reg = new detail::fd_registration{};
+    reg->fd_ = fd;
+    reg->interest_ = static_cast<uint32_t>(interest);
+
+    if (!arm_registration(r, *reg))
+    {
+        delete reg;
+        throw std::runtime_error{"Failed to register fd " + std::to_string(fd) + " errno=[" + std::string{strerror(errno)} + "]"};
+    }
+
+    return registered_fd{*this, r, *reg};
+}
+
+auto IOScheduler::poll(registered_fd& fd, coro::PollOption op, std::chrono::milliseconds timeout)
+    -> poll_operation
+{
+    auto& reg = *fd.reg_;
+
+    if (op == PollOption::READ_WRITE || (reg.interest_ & static_cast<uint32_t>(op)) == 0)
+    {
+        throw std::runtime_error{"registered fds are polled for one direction they were registered for"};
+    }
+
+    return poll_operation{*this, *fd.reactor_, reg.fd_, op, timeout, &reg};
+}
+
+IOScheduler::poll_operation::poll_operation(
+    IOScheduler& scheduler,
+    reactor& r,
+    fd_t fd,
+    coro::PollOption op,
+    std::chrono::milliseconds timeout,
+    detail::fd_registration* reg) noexcept
+    : scheduler_(scheduler)
+    , reactor_(r)
+    , reg_(reg)
+    , op_(op)
+    , timeout_(timeout)
+{
+    pi_.fd_ = fd;
+}
+
+// Epoll bits that complete a registered poll in direction op, and the ones it consumes.
+static auto registered_masks(coro::PollOption op) noexcept -> std::pair<uint32_t, uint32_t>
+{
+    if (op == PollOption::READ)
+    {
+        return {EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR, EPOLLIN};
+    }
+    return {EPOLLOUT | EPOLLHUP | EPOLLERR, EPOLLOUT};
+}
+
+bool IOScheduler::poll_operation::await_ready() noexcept
+{
+    if (reg_ == nullptr)
+    {
+        return false;
+    }
+
+    // Readiness the reactor already saw needs no syscall at all.
+    auto [mask, consumed] = registered_masks(op_);
+    if (auto ready = reg_->ready_.fetch_and(~consumed, std::memory_order::seq_cst); (ready & mask) != 0)
+    {
+        pi_.poll_status_ = event_to_poll_status(ready & mask);
+        return true;
+    }
+    return false;
+}
+
+bool IOScheduler::poll_operation::suspend(std::coroutine_handle<> awaiting_coroutine, const std::stop_token& token) noexcept
+{
+    if (token.stop_requested())
+    {
+        pi_.poll_status_ = PollStatus::CANCELLED;
+        return false;
+    }
+
+    // The size drops when the awaiting coroutine suspends, every poll undoes
+    // that while it waits on the event loop.
+    scheduler_.size_.fetch_add(1, std::memory_order::release);
+    suspended_ = true;
+    pi_.awaiting_coroutine_ = awaiting_coroutine;
+
+    if (reg_ == nullptr)
+    {
+        // A timeout and the fd event race, whichever triggers first removes
+        // the other so the coroutine is only ever resumed once. Both are kept
+        // on the same reactor so a single io thread sees them. epoll refuses
+        // a bad or already watched fd right away, so it is armed first and
+        // the poll fails before anything else is in place. io_uring reports
+        // that in the completion, its poll is armed last as it is what
+        // usually wakes the io thread.
+        const uint32_t events = static_cast<uint32_t>(op_) | EPOLLONESHOT | EPOLLRDHUP;
+        if (reactor_.uring_ == nullptr && !scheduler_.arm_poll(reactor_, pi_.fd_, events, &pi_))
+        {
+            pi_.poll_status_ = PollStatus::ERROR;
+            suspended_ = false;
+            scheduler_.size_.fetch_sub(1, std::memory_order::release);
+            return false;
+        }
+
+        scheduler_.watch_stop(reactor_, pi_, token, stop_callback_);
+        if (timeout_ > 0ms)
+        {
+            scheduler_.add_timer_token(reactor_, clock::now() + timeout_, pi_);
+        }
+
+        if (reactor_.uring_ != nullptr)
+        {
+            pi_.armed_ = true;
+            scheduler_.arm_poll(reactor_, pi_.fd_, events, &pi_);
+        }
+    }
+    else
+    {
+        auto [mask, consumed] = registered_masks(op_);
+        auto& slot = (op_ == PollOption::READ) ? reg_->reader_ : reg_->writer_;
+        pi_.slot_ = &slot;
+        slot.store(&pi_, std::memory_order::seq_cst);
+
+        // An edge may have landed before the slot was published. Take it back
+        // unless the io thread already did, then it is resuming us anyway.
+        if (auto ready = reg_->ready_.fetch_and(~consumed, std::memory_order::seq_cst); (ready & mask) != 0)
+        {
+            auto* expected = &pi_;
+            if (slot.compare_exchange_strong(expected, nullptr, std::memory_order::seq_cst))
+            {
+                pi_.poll_status_ = event_to_poll_status(ready & mask);
+                suspended_ = false;
+                scheduler_.size_.fetch_sub(1, std::memory_order::release);
+                return false;
+            }
+        }
+
+        // Only added once this poll is certain to suspend, from then on the
+        // io thread alone decides between the event and the timeout.
+        if (timeout_ > 0ms)
+        {
+            scheduler_.add_timer_token(reactor_, clock::now() + timeout_, pi_);
+        }
+        scheduler_.watch_stop(reactor_, pi_, token, stop_callback_);
+    }
+
+    // The io thread waits for publish(), nothing here is touched after it.
+    publish(pi_);
+    return true;
+}
+
+PollStatus IOScheduler::poll_operation::await_resume() noexcept
+{
+    if (suspended_)
+    {
+        scheduler_.size_.fetch_sub(1, std::memory_order::release);
+    }
+    return pi_.poll_status_;
+}
+
+auto IOScheduler::read_at(fd_t fd, void* buffer, std::size_t size, off_t offset) -> file_operation
+{
+    return file_operation{*this, file_request{
+        .op_ = FileOp::READ, .fd_ = fd, .buffer_ = buffer, .size_ = size, .offset_ = offset}};
+}
+
+auto IOScheduler::write_at(fd_t fd, const void* buffer, std::size_t size, off_t offset) -> file_operation
+{
+    return file_operation{*this, file_request{
+        .op_ = FileOp::WRITE, .fd_ = fd, .buffer_ = const_cast<void*>(buffer), .size_ = size, .offset_ = offset}};
+}
+
+auto IOScheduler::fsync(fd_t fd, bool data_only) -> file_operation
+{
+    return file_operation{*this, file_request{.op_ = data_only ? FileOp::FDATASYNC : FileOp::FSYNC, .fd_ = fd}};
+}
+
+auto IOScheduler::fallocate(fd_t fd, int mode, off_t offset, off_t length) -> file_operation
+{
+    return file_operation{*this, file_request{
+        .op_ = FileOp::FALLOCATE, .fd_ = fd, .mode_ = mode, .size_ = static_cast<std::size_t>(length), .offset_ = offset}};
+}
+
+bool IOScheduler::file_operation::await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
+{
+    auto& r = scheduler_.local_reactor();
+
+    // Offloading costs two thread hops, a read the page cache can serve is
+    // cheaper done right here. Any failure, EAGAIN or an old kernel's
+    // EINVAL alike, leaves it to the pool.
+    if (r.uring_ == nullptr && request_.op_ == FileOp::READ)
+    {
+        iovec iov{.iov_base = request_.buffer_, .iov_len = request_.size_};
+        if (auto result = ::preadv2(request_.fd_, &iov, 1, request_.offset_, RWF_NOWAIT); result >= 0)
+        {
+            request_.result_ = result;
+            return false;
+        }
+    }
+
+    // Like a poll the operation is live in the scheduler until it resumes.
+    scheduler_.size_.fetch_add(1, std::memory_order::release);
+    suspended_ = true;
+
+    request_.reactor_ = &r;
+    request_.awaiting_coroutine_ = awaiting_coroutine;
+    scheduler_.submit_file(r, request_);
+    return true;
+}
+
+int64_t IOScheduler::file_operation::await_resume() noexcept
+{
+    if (suspended_)
+    {
+        scheduler_.size_.fetch_sub(1, std::memory_order::release);
+    }
+    return request_.result_;
+}
+
+void IOScheduler::shutdown() noexcept
+{
+    if (shutdown_requested_.exchange(true, std::memory_order::acq_rel) == false)
+    {
+        if (thread_pool_ != nullptr)
+        {
+            thread_pool_->shutdown();
+        }
+
+        // Wake the event loops so they notice, writing an eventfd is always safe.
+        uint64_t value{1};
+        auto written = ::write(shutdown_fd_, &value, sizeof(value));
+        (void)written;
+
+        for (auto& r : reactors_)
+        {
+            if (r->io_thread_.joinable())
+            {
+                r->io_thread_.join();
+            }
+        }
+
+        // The event loops waited for every file operation to resume.
+        stop_file_threads();
+    }
+}
+
+void IOScheduler::garbage_collect() noexcept
+{
+    auto* tc = static_cast<coro::TaskContainer<coro::IOScheduler>*>(owned_tasks_);
+    tc->garbage_collect();
+}
+
+auto IOScheduler::local_reactor() noexcept -> reactor&
+{
+    if (current_reactor_ != nullptr && current_reactor_->scheduler_ == this)
+    {
+        return *current_reactor_;
+    }
+
+    if (reactors_.size() == 1)
+    {
+        return *reactors_.front();
+    }
+
+    // Any other thread sticks to one reactor, they are handed out round robin.
+    static std::atomic<std::size_t> next_slot{0};
+    thread_local const std::size_t slot = next_slot.fetch_add(1, std::memory_order::relaxed);
+    return *reactors_[slot % reactors_.size()];
+}
+
+void IOScheduler::schedule_inline(reactor& r, scheduled_node& node)
+{
+    size_.fetch_add(1, std::memory_order::release);
+    r.scheduled_.push(node);
+    wake_inline(r);
+}
+
+void IOScheduler::schedule_inline(reactor& r, std::coroutine_handle<> handle)
+{
+    size_.fetch_add(1, std::memory_order::release);
+    if (!r.resumed_.try_push(handle.address()))
+    {
+        std::scoped_lock lk{r.scheduled_tasks_mtx_};
+        r.scheduled_tasks_.emplace_back(handle);
+        r.overflowed_.fetch_add(1, std::memory_order::release);
+    }
+    wake_inline(r);
+}
+
+void IOScheduler::wake_inline(reactor& r)
+{
+    // The io thread clears the flag before taking the queues, anything pushed
+    // after that either sees it clear and writes or finds a wakeup pending.
+    bool expected{false};
+    if (r.schedule_fd_triggered_.compare_exchange_strong(
+                expected, true, std::memory_order::seq_cst, std::memory_order::relaxed))
+    {
+        eventfd_t value{1};
+        eventfd_write(r.schedule_fd_, value);
+    }
 }
 
-auto IOScheduler::schedule_after(std::chrono::milliseconds amound) -> coro::task<void>
+bool IOScheduler::arm_poll(reactor& r, fd_t fd, uint32_t events, const void* user_data)
 {
-    return yield_for(amount);
+    if (r.uring_ != nullptr)
+    {
+        std::scoped_lock lk{r.uring_mtx_};
+        auto& sqe = next_sqe(r);
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = fd;
+        sqe.poll32_events = events;
+        sqe.user_data = reinterpret_cast<uint64_t>(user_data);
+        submit_sqes(r);
+        return true;
+    }
+
+    epoll_event e{};
+    e.events = events;
+    e.data.ptr = const_cast<void*>(user_data);
+    return epoll_ctl(r.epoll_fd_, EPOLL_CTL_ADD, fd, &e) == 0;
+}
+
+void IOScheduler::arm_wakeup(reactor& r, fd_t fd, const void* user_data)
+{
+    if (r.uring_ == nullptr)
+    {
+        arm_poll(r, fd, EPOLLIN, user_data);
+        return;
+    }
+
+    // Multishot polls stay armed, a single shot one is re-armed once handled.
+    std::scoped_lock lk{r.uring_mtx_};
+    auto& sqe = next_sqe(r);
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd;
+    sqe.len = r.uring_->multishot_poll() ? IORING_POLL_ADD_MULTI : 0;
+    sqe.poll32_events = EPOLLIN;
+    sqe.user_data = reinterpret_cast<uint64_t>(user_data);
+    submit_sqes(r);
+}
+
+void IOScheduler::submit_sqes(reactor& r)
+{
+    // The io thread's entries go in with the io_uring_enter() it waits in
+    // next, any other thread cannot count on that and enters right away.
+    if (current_reactor_ != &r)
+    {
+        r.uring_->submit();
+    }
+}
+
+bool IOScheduler::disarm_poll(reactor& r, detail::poll_info& pi)
+{
+    if (pi.fd_ == -1)
+    {
+        return true;
+    }
+
+    if (r.uring_ != nullptr)
+    {
+        if (!pi.armed_)
+        {
+            return true;
+        }
+
+        // The poll's own completion, -ECANCELED or a late event, hands the
+        // coroutine back once the kernel let go of pi.
+        std::scoped_lock lk{r.uring_mtx_};
+        auto& sqe = next_sqe(r);
+        sqe.opcode = IORING_OP_POLL_REMOVE;
+        sqe.addr = reinterpret_cast<uint64_t>(&pi);
+        sqe.user_data = reinterpret_cast<uint64_t>(cancel_ptr_);
+        submit_sqes(r);
+        return false;
+    }
+
+    // Always remove the fd so the next poll can blindly EPOLL_CTL_ADD.
+    epoll_ctl(r.epoll_fd_, EPOLL_CTL_DEL, pi.fd_, nullptr);
+    return true;
+}
+
+bool IOScheduler::arm_registration(reactor& r, detail::fd_registration& reg)
+{
+    if (r.epoll_fd_ == -1)
+    {
+        std::scoped_lock lk{r.uring_mtx_};
+        submit_registration(r, reg);
+        return true;
+    }
+
+    epoll_event e{};
+    e.events = reg.interest_ | EPOLLRDHUP | EPOLLET;
+    e.data.u64 = reinterpret_cast<uintptr_t>(&reg) | registration_tag_;
+    return epoll_ctl(r.epoll_fd_, EPOLL_CTL_ADD, reg.fd_, &e) == 0;
 }
 
-auto IOScheduler::schedule_at(time_point time) -> coro::task<void>
+void IOScheduler::submit_registration(reactor& r, detail::fd_registration& reg)
 {
-    return yield_until(time);
+    // Multishot polls post a completion per wakeup until removed.
+    auto& sqe = next_sqe(r);
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = reg.fd_;
+    sqe.len = IORING_POLL_ADD_MULTI;
+    sqe.poll32_events = reg.interest_ | EPOLLRDHUP;
+    sqe.user_data = reinterpret_cast<uintptr_t>(&reg) | registration_tag_;
+    submit_sqes(r);
 }
 
-auto IOScheduler::yield_for()
+void IOScheduler::unregister_fd(reactor& r, detail::fd_registration& reg) noexcept
+{
+    if (r.epoll_fd_ == -1)
+    {
+        // The multishot poll's last completion releases reg, unless it
+        // already came.
+        std::unique_lock lk{r.uring_mtx_};
+        reg.retired_ = true;
+        if (!reg.failed_)
+        {
+            auto& sqe = next_sqe(r);
+            sqe.opcode = IORING_OP_POLL_REMOVE;
+            sqe.addr = reinterpret_cast<uintptr_t>(&reg) | registration_tag_;
+            sqe.user_data = reinterpret_cast<uint64_t>(cancel_ptr_);
+            submit_sqes(r);
+        }
+        else
+        {
+            lk.unlock();
+            std::scoped_lock released_lk{r.retired_mtx_};
+            reg.released_ = true;
+        }
+    }
+    else
+    {
+        // A batch already fetched may still mention reg, the io thread frees
+        // it before fetching the next one.
+        epoll_ctl(r.epoll_fd_, EPOLL_CTL_DEL, reg.fd_, nullptr);
+        reg.retired_ = true;
+        std::scoped_lock lk{r.retired_mtx_};
+        reg.released_ = true;
+    }
+
+    std::scoped_lock lk{r.retired_mtx_};
+    r.retired_.emplace_back(&reg);
+}
+
+void IOScheduler::free_released(reactor& r)
+{
+    std::scoped_lock lk{r.retired_mtx_};
+    std::erase_if(r.retired_, [](detail::fd_registration* reg)
+            {
+                if (reg->released_)
+                {
+                    delete reg;
+                    return true;
+                }
+                return false;
+            });
+}
+
+io_uring_sqe& IOScheduler::next_sqe(reactor& r)
+{
+    while (true)
+    {
+        if (auto* sqe = r.uring_->get_sqe(); sqe != nullptr)
+        {
+            return *sqe;
+        }
+
+        if (r.uring_->submit() < 0)
+        {
+            std::this_thread::yield();
+        }
+    }
 }
+
+void IOScheduler::process_events_manual(reactor& r, std::chrono::milliseconds timeout)
+{
+    bool expected{false};
+    if (r.io_processing_.compare_exchange_strong(expected, true, std::memory_order::release, std::memory_order::relaxed))
+    {
+        auto* previous = std::exchange(current_reactor_, &r);
+        process_events_execute(r, timeout);
+        current_reactor_ = previous;
+
+        // Nothing waits on the ring until the caller comes back, whatever
+        // the batch queued is submitted now.
+        if (r.uring_ != nullptr)
+        {
+            std::scoped_lock lk{r.uring_mtx_};
+            r.uring_->submit();
+        }
+        r.io_processing_.exchange(false, std::memory_order::release);
+    }
+}
+
+void IOScheduler::process_events_dedicated_thread(reactor& r)
+{
+    if (opts_.on_io_thread_start_functor != nullptr)
+    {
+        opts_.on_io_thread_start_functor();
+    }
+
+    current_reactor_ = &r;
+    r.io_processing_.exchange(true, std::memory_order::release);
+    // Execute tasks until stopped or there are no more tasks to complete.
+    while (!shutdown_requested_.load(std::memory_order::acquire) || size() > 0)
+    {
+        process_events_execute(r, default_timeout_);
+    }
+    r.io_processing_.exchange(false, std::memory_order::release);
+    current_reactor_ = nullptr;
+
+    if (opts_.on_io_thread_stop_functor != nullptr)
+    {
+        opts_.on_io_thread_stop_functor();
+    }
+}
+
+void IOScheduler::process_events_execute(reactor& r, std::chrono::milliseconds timeout)
+{
+    const auto start = clock::now();
+    free_released(r);
+
+    if (r.uring_ != nullptr)
+    {
+        process_events_execute_uring(r, timeout);
+    }
+    else
+    {
+        const int max_events = static_cast<int>(r.events_.size());
+        int event_count{0};
+        bool busy{false};
+
+        if (opts_.busy_poll > 0us && timeout > 0ms)
+        {
+            const auto spin_until = clock::now() + std::min<std::chrono::microseconds>(opts_.busy_poll, timeout);
+            do
+            {
+                event_count = epoll_wait(r.epoll_fd_, r.events_.data(), max_events, 0);
+            }
+            while (event_count == 0 && clock::now() < spin_until);
+            busy = (event_count > 0);
+        }
+
+        if (!busy)
+        {
+            event_count = epoll_wait(r.epoll_fd_, r.events_.data(), max_events, timeout.count());
+        }
+        r.woke_ = clock::now();
+        record_wakeup(r, static_cast<std::size_t>(std::max(event_count, 0)), busy);
+
+        for (std::size_t i = 0; i < static_cast<std::size_t>(std::max(event_count, 0)); ++i)
+        {
+            epoll_event& event = r.events_[i];
+            void* handle_ptr = event.data.ptr;
+
+            if (handle_ptr == timer_ptr_)
+            {
+                process_timeout_execute(r);
+            }
+            else if (handle_ptr == schedule_ptr_)
+            {
+                process_scheduled_execute_inline(r);
+            }
+            else if (handle_ptr == shutdown_ptr_) [[unlikely]]
+            {
+                // Nothing to do, just needed to wake up.
+            }
+            else if ((event.data.u64 & registration_tag_) != 0)
+            {
+                auto* reg = reinterpret_cast<detail::fd_registration*>(event.data.u64 & ~registration_tag_);
+                process_registration_execute(r, *reg, event.events);
+            }
+            else
+            {
+                process_event_execute(r, static_cast<detail::poll_info*>(handle_ptr), event_to_poll_status(event.events));
+            }
+        }
+    }
+
+    // Nothing is resumed until the whole batch is accounted for. If an event
+    // and the timeout of the same poll show up together, resuming inline
+    // would destroy the poll_info before the second one is looked at.
+    if (!r.handles_to_resume_.empty())
+    {
+        record(r.resume_batch_size_, r.handles_to_resume_.size());
+        if (queues_inline())
+        {
+            for (auto& handle : r.handles_to_resume_)
+            {
+                run_continuation(r, handle);
+            }
+        }
+        else
+        {
+            thread_pool_->resume(r.handles_to_resume_);
+        }
+
+        r.handles_to_resume_.clear();
+    }
+
+    record_iteration(r, start);
+}
+
+void IOScheduler::process_events_execute_uring(reactor& r, std::chrono::milliseconds timeout)
+{
+    bool busy{false};
+
+    // Completions land in shared memory, spinning does not enter the kernel.
+    // What the last batch queued is submitted before, or nothing would land.
+    if (opts_.busy_poll > 0us && timeout > 0ms)
+    {
+        {
+            std::scoped_lock lk{r.uring_mtx_};
+            r.uring_->submit();
+        }
+
+        const auto spin_until = clock::now() + std::min<std::chrono::microseconds>(opts_.busy_poll, timeout);
+        while (r.uring_->ready() == 0 && clock::now() < spin_until)
+        {
+        }
+        busy = (r.uring_->ready() > 0);
+    }
+
+    if (!busy)
+    {
+        const auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        const timespec ts{
+            .tv_sec = static_cast<time_t>(secs.count()),
+            .tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - secs).count())};
+
+        // The entries the last batch queued are submitted by the same
+        // io_uring_enter() that waits.
+        uint32_t pending{0};
+        {
+            std::scoped_lock lk{r.uring_mtx_};
+            pending = r.uring_->publish();
+        }
+        r.uring_->wait(&ts, pending);
+    }
+    r.woke_ = clock::now();
+
+    // A completion without F_MORE ended its poll, the wakeup fds are re-armed
+    // once handled.
+    auto reaped = r.uring_->reap([this, &r](const io_uring_cqe& cqe)
+            {
+                void* handle_ptr = reinterpret_cast<void*>(cqe.user_data);
+
+                if (handle_ptr == timer_ptr_)
+                {
+                    process_timeout_execute(r);
+                    if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+                    {
+                        arm_wakeup(r, r.timer_fd_, timer_ptr_);
+                    }
+                }
+                else if (handle_ptr == schedule_ptr_)
+                {
+                    process_scheduled_execute_inline(r);
+                    if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+                    {
+                        arm_wakeup(r, r.schedule_fd_, schedule_ptr_);
+                    }
+                }
+                else if (handle_ptr == registrations_ptr_)
+                {
+                    // Registered fds that wait in epoll_fd_, handled like the epoll backend does.
+                    const int count = epoll_wait(r.epoll_fd_, r.events_.data(), static_cast<int>(r.events_.size()), 0);
+                    for (int i = 0; i < count; ++i)
+                    {
+                        auto* reg = reinterpret_cast<detail::fd_registration*>(r.events_[i].data.u64 & ~registration_tag_);
+                        process_registration_execute(r, *reg, r.events_[i].events);
+                    }
+
+                    if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+                    {
+                        arm_wakeup(r, r.epoll_fd_, registrations_ptr_);
+                    }
+                }
+                else if (handle_ptr == shutdown_ptr_ || handle_ptr == cancel_ptr_) [[unlikely]]
+                {
+                    // Shutdown only needs to wake the loop once, poll removals carry no news.
+                }
+                else if ((cqe.user_data & file_tag_) != 0)
+                {
+                    auto* request = reinterpret_cast<file_request*>(cqe.user_data & ~file_tag_);
+                    request->result_ = cqe.res;
+                    r.handles_to_resume_.emplace_back(request->awaiting_coroutine_);
+                }
+                else if ((cqe.user_data & registration_tag_) != 0)
+                {
+                    auto* reg = reinterpret_cast<detail::fd_registration*>(cqe.user_data & ~registration_tag_);
+                    if (cqe.res != -ECANCELED)
+                    {
+                        process_registration_execute(r, *reg, cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res));
+                    }
+
+                    // Without F_MORE the multishot poll ended. It is re-armed
+                    // unless its handle is gone or the kernel refused the fd,
+                    // a bad fd would fail again on every submission. Deciding
+                    // under uring_mtx_ keeps a concurrent removal from
+                    // missing the new poll.
+                    if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+                    {
+                        std::unique_lock lk{r.uring_mtx_};
+                        if (!reg->retired_ && cqe.res < 0 && cqe.res != -ECANCELED)
+                        {
+                            // The error stays cached, polls complete with ERROR.
+                            reg->failed_ = true;
+                        }
+                        else if (!reg->retired_)
+                        {
+                            submit_registration(r, *reg);
+                        }
+                        else
+                        {
+                            lk.unlock();
+                            std::scoped_lock released_lk{r.retired_mtx_};
+                            reg->released_ = true;
+                        }
+                    }
+                }
+                else
+                {
+                    auto* pi = static_cast<detail::poll_info*>(handle_ptr);
+                    pi->armed_ = false;
+                    if (pi->processed_)
+                    {
+                        // Timed out earlier, this is the completion of its removal.
+                        resume_poll(r, *pi);
+                    }
+                    else
+                    {
+                        process_event_execute(r, pi, cqe.res < 0 ? PollStatus::ERROR : event_to_poll_status(cqe.res));
+                    }
+                }
+            }, opts_.max_events);
+    record_wakeup(r, reaped, busy);
+}
+
+void IOScheduler::record_wakeup(reactor& r, std::size_t count, bool busy) noexcept
+{
+    bump(r.wakeups_);
+    bump(r.events_seen_, count);
+    if (busy)
+    {
+        bump(r.busy_poll_wakeups_);
+    }
+    record(r.events_per_wakeup_, count);
+}
+
+void IOScheduler::record_iteration(reactor& r, time_point start) noexcept
+{
+    // One more clock read per iteration, the wakeup time was taken anyway.
+    const auto blocked = std::chrono::duration_cast<std::chrono::nanoseconds>(r.woke_ - start);
+    const auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - r.woke_);
+
+    bump(r.loop_iterations_);
+    bump(r.blocked_ns_, static_cast<uint64_t>(blocked.count()));
+    bump(r.busy_ns_, static_cast<uint64_t>(busy.count()));
+    record(r.loop_duration_, static_cast<uint64_t>(busy.count()) / 1000);
+}
+
+IOScheduler::metrics_snapshot IOScheduler::metrics() const
+{
+    metrics_snapshot snapshot{};
+    snapshot.reactors.reserve(reactors_.size());
+
+    for (const auto& r : reactors_)
+    {
+        reactor_metrics m{
+            .wakeups = r->wakeups_.load(std::memory_order::relaxed),
+            .events = r->events_seen_.load(std::memory_order::relaxed),
+            .busy_poll_wakeups = r->busy_poll_wakeups_.load(std::memory_order::relaxed),
+            .events_per_wakeup = {},
+            .timer_rearms = r->timer_rearms_.load(std::memory_order::relaxed),
+            .timer_rearms_avoided = r->timer_rearms_avoided_.load(std::memory_order::relaxed),
+            .inline_resumes = r->inline_resumes_.load(std::memory_order::relaxed),
+            .offloaded_resumes = r->offloaded_resumes_.load(std::memory_order::relaxed),
+            .budget_overruns = r->budget_overruns_.load(std::memory_order::relaxed),
+            .loop_iterations = r->loop_iterations_.load(std::memory_order::relaxed),
+            .blocked_time = std::chrono::nanoseconds{r->blocked_ns_.load(std::memory_order::relaxed)},
+            .busy_time = std::chrono::nanoseconds{r->busy_ns_.load(std::memory_order::relaxed)},
+            .loop_duration = {},
+            .timer_lateness = {},
+            .scheduled_batch_size = {},
+            .resume_batch_size = {}};
+
+        for (std::size_t i = 0; i < event_batch_buckets; ++i)
+        {
+            m.events_per_wakeup[i] = r->events_per_wakeup_[i].load(std::memory_order::relaxed);
+            m.scheduled_batch_size[i] = r->scheduled_batch_size_[i].load(std::memory_order::relaxed);
+            m.resume_batch_size[i] = r->resume_batch_size_[i].load(std::memory_order::relaxed);
+        }
+
+        for (std::size_t i = 0; i < latency_buckets; ++i)
+        {
+            m.loop_duration[i] = r->loop_duration_[i].load(std::memory_order::relaxed);
+            m.timer_lateness[i] = r->timer_lateness_[i].load(std::memory_order::relaxed);
+        }
+
+        snapshot.reactors.emplace_back(m);
+    }
+
+    return snapshot;
+}
+
+PollStatus IOScheduler::event_to_poll_status(uint32_t events)
+{
+    if (events & EPOLLIN || events & EPOLLOUT)
+    {
+        return PollStatus::EVENT;
+    }
+    else if (events & EPOLLERR)
+    {
+        return PollStatus::ERROR;
+    }
+    else if (events & EPOLLRDHUP || events & EPOLLHUP)
+    {
+        return PollStatus::CLOSED;
+    }
+
+    throw std::runtime_error{"invalid epoll state"};
+}
+
+void IOScheduler::process_scheduled_execute_inline(reactor& r)
+{
+    // A multishot poll completes on every write, not on the level, so the
+    // counter is left to grow instead of costing a read per wakeup.
+    if (r.uring_ == nullptr || !r.uring_->multishot_poll())
+    {
+        eventfd_t value{0};
+        eventfd_read(r.schedule_fd_, &value);
+    }
+
+    // Clear the in memory flag to reduce eventfd_* calls on scheduling.
+    r.schedule_fd_triggered_.exchange(false, std::memory_order::seq_cst);
+
+    // Stop requests and offloaded file operations share the wakeup, their
+    // coroutines resume with the batch.
+    if (!r.cancelled_.empty())
+    {
+        process_cancelled_execute(r);
+    }
+
+    if (!r.files_done_.empty())
+    {
+        process_files_done_execute(r);
+    }
+
+    // These have no timeout event attached and can be resumed right away.
+    // Each node lives in the frame it resumes, step past it first.
+    std::size_t resumed{0};
+    for (auto* node = r.scheduled_.take_all(); node != nullptr; ++resumed)
+    {
+        auto handle = node->handle_;
+        node = node->next_;
+        run_continuation(r, handle);
+    }
+
+    // Only drain what is there now, handles resumed here may queue more.
+    for (std::size_t n = r.resumed_.size(); n > 0; --n)
+    {
+        auto address = r.resumed_.try_pop();
+        if (!address.has_value())
+        {
+            break;
+        }
+        run_continuation(r, std::coroutine_handle<>::from_address(*address));
+        ++resumed;
+    }
+
+    if (r.overflowed_.load(std::memory_order::acquire) > 0)
+    {
+        std::vector<std::coroutine_handle<>> tasks{};
+        {
+            std::scoped_lock lk{r.scheduled_tasks_mtx_};
+            tasks.swap(r.scheduled_tasks_);
+            r.overflowed_.fetch_sub(tasks.size(), std::memory_order::release);
+        }
+
+        for (auto& task : tasks)
+        {
+            run_continuation(r, task);
+        }
+        resumed += tasks.size();
+    }
+
+    record(r.scheduled_batch_size_, resumed);
+    size_.fetch_sub(resumed, std::memory_order::release);
+}
+
+void IOScheduler::cancel_request::operator()() noexcept
+{
+    auto expected = detail::poll_info::cancel_none;
+    if (pi_->cancel_state_.compare_exchange_strong(expected, detail::poll_info::cancel_queued, std::memory_order::acq_rel))
+    {
+        // Once queued the io thread may end the wait, only the reactor is
+        // touched after the push.
+        auto& scheduler = *scheduler_;
+        auto& r = *reactor_;
+        r.cancelled_.push(*this);
+        scheduler.wake_inline(r);
+    }
+}
+
+void IOScheduler::watch_stop(reactor& r, detail::poll_info& pi, const std::stop_token& token,
+        std::optional<std::stop_callback<cancel_request>>& callback) noexcept
+{
+    if (token.stop_possible())
+    {
+        pi.stoppable_ = true;
+        callback.emplace(token, cancel_request{.scheduler_ = this, .reactor_ = &r, .pi_ = &pi});
+    }
+}
+
+void IOScheduler::publish(detail::poll_info& pi) noexcept
+{
+    // The io thread may end the wait as soon as the store lands, a wake on a
+    // futex word that is already gone is harmless.
+    if (pi.published_.exchange(detail::poll_info::publish_done, std::memory_order::acq_rel)
+        == detail::poll_info::publish_waiting)
+    {
+        detail::futex_wake(pi.published_);
+    }
+}
+
+void IOScheduler::wait_published(detail::poll_info& pi) noexcept
+{
+    // Publishing is a few instructions away unless the awaiter's thread was
+    // preempted, then blocking lets it run instead of burning its time slice.
+    for (uint32_t spins = 0; spins < 64; ++spins)
+    {
+        if (pi.published_.load(std::memory_order::acquire) == detail::poll_info::publish_done)
+        {
+            return;
+        }
+    }
+
+    auto state = pi.published_.load(std::memory_order::acquire);
+    while (state != detail::poll_info::publish_done)
+    {
+        if (state == detail::poll_info::publish_waiting
+            || pi.published_.compare_exchange_weak(state, detail::poll_info::publish_waiting, std::memory_order::acquire))
+        {
+            detail::futex_wait(pi.published_, detail::poll_info::publish_waiting);
+            state = pi.published_.load(std::memory_order::acquire);
+        }
+    }
+}
+
+void IOScheduler::resume_poll(reactor& r, detail::poll_info& pi)
+{
+    if (pi.stoppable_)
+    {
+        auto expected = detail::poll_info::cancel_none;
+        if (!pi.cancel_state_.compare_exchange_strong(expected, detail::poll_info::cancel_done, std::memory_order::acq_rel)
+            && expected == detail::poll_info::cancel_queued)
+        {
+            // The request is still queued and references pi.
+            pi.deferred_ = true;
+            return;
+        }
+    }
+
+    r.handles_to_resume_.emplace_back(pi.awaiting_coroutine_);
+}
+
+void IOScheduler::process_cancelled_execute(reactor& r)
+{
+    for (auto* request = r.cancelled_.take_all(); request != nullptr;)
+    {
+        auto* pi = request->pi_;
+        request = request->next_;
+        pi->cancel_state_.store(detail::poll_info::cancel_done, std::memory_order::release);
+        wait_published(*pi);
+
+        if (pi->deferred_)
+        {
+            // The wait ended before its request was taken.
+            r.handles_to_resume_.emplace_back(pi->awaiting_coroutine_);
+        }
+        else if (pi->slot_ != nullptr)
+        {
+            // Otherwise the event or the timeout already emptied the slot,
+            // and deferred_ would be set.
+            auto* expected = pi;
+            if (pi->slot_->compare_exchange_strong(expected, nullptr, std::memory_order::seq_cst))
+            {
+                pi->processed_ = true;
+                remove_timer_token(r, *pi);
+                pi->poll_status_ = PollStatus::CANCELLED;
+                r.handles_to_resume_.emplace_back(pi->awaiting_coroutine_);
+            }
+        }
+        else if (!pi->processed_)
+        {
+            // Exactly what a timeout does. An io_uring poll is resumed by
+            // the completion of its removal.
+            pi->processed_ = true;
+            remove_timer_token(r, *pi);
+            pi->poll_status_ = PollStatus::CANCELLED;
+            if (disarm_poll(r, *pi))
+            {
+                r.handles_to_resume_.emplace_back(pi->awaiting_coroutine_);
+            }
+        }
+    }
+}
+
+void IOScheduler::run_continuation(reactor& r, std::coroutine_handle<> handle)
+{
+    if (opts_.execution_strategy != ExecutionStrategy::PROCESS_TASKS_ADAPTIVE)
+    {
+        handle.resume();
+        return;
+    }
+
+    void* address = handle.address();
+    const auto hash = (reinterpret_cast<uintptr_t>(address) >> 4) * uint64_t{0x9e3779b97f4a7c15};
+    auto& entry = r.overruns_[(hash >> 32) % overrun_slots_];
+
+    // GCC and Clang both lay a frame out with its resume function first.
+    void* resume{nullptr};
+    std::memcpy(&resume, address, sizeof(resume));
+    const bool known = (entry.address_ == address && entry.resume_ == resume);
+
+    if (known && entry.offloads_left_ > 0)
+    {
+        --entry.offloads_left_;
+        bump(r.offloaded_resumes_);
+        thread_pool_->resume(handle);
+        return;
+    }
+
+    // Running it is the only way to learn how long it takes, a coroutine
+    // over budget has already held up the loop once.
+    const auto start = clock::now();
+    handle.resume();
+    const auto elapsed = clock::now() - start;
+    bump(r.inline_resumes_);
+
+    // The frame may be gone by now, only what was read before is kept.
+    if (elapsed > opts_.inline_budget)
+    {
+        bump(r.budget_overruns_);
+        entry.address_ = address;
+        entry.resume_ = resume;
+        entry.offloads_left_ = overrun_offloads_;
+    }
+    else if (known)
+    {
+        entry.address_ = nullptr;
+    }
+}
+
+void IOScheduler::process_event_execute(reactor& r, detail::poll_info* pi, PollStatus status)
+{
+    if (!pi->processed_)
+    {
+        // poll() registers the timer and the fd before suspending, waiting for
+        // it guarantees both are in place before touching either.
+        wait_published(*pi);
+
+        // The event and the timeout may arrive in the same batch, only the
+        // first one is processed.
+        pi->processed_ = true;
+
+        disarm_poll(r, *pi);
+        remove_timer_token(r, *pi);
+
+        pi->poll_status_ = status;
+        resume_poll(r, *pi);
+    }
+}
+
+void IOScheduler::process_registration_execute(reactor& r, detail::fd_registration& reg, uint32_t events)
+{
+    reg.ready_.fetch_or(events, std::memory_order::seq_cst);
+    wake_registered(r, reg, reg.reader_, events, EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR, EPOLLIN);
+    wake_registered(r, reg, reg.writer_, events, EPOLLOUT | EPOLLHUP | EPOLLERR, EPOLLOUT);
+}
+
+void IOScheduler::wake_registered(reactor& r, detail::fd_registration& reg, std::atomic<detail::poll_info*>& slot,
+        uint32_t events, uint32_t mask, uint32_t consumed)
+{
+    const uint32_t seen = reg.ready_.load(std::memory_order::seq_cst);
+    if ((seen & mask) == 0)
+    {
+        return;
+    }
+
+    // Pairs with the store and re-check in poll(), either it sees the bits
+    // or this sees its poll_info.
+    auto* pi = slot.exchange(nullptr, std::memory_order::seq_cst);
+    if (pi == nullptr)
+    {
+        return;
+    }
+
+    const uint32_t ready = reg.ready_.fetch_and(~consumed, std::memory_order::seq_cst);
+    wait_published(*pi);
+
+    pi->processed_ = true;
+    remove_timer_token(r, *pi);
+    pi->poll_status_ = event_to_poll_status((seen | ready | events) & mask);
+    resume_poll(r, *pi);
+}
+
+void IOScheduler::process_timeout_execute(reactor& r)
+{
+    auto now = clock::now();
+
+    {
+        std::scoped_lock lk{r.timed_events_mtx_};
+        r.timed_events_.expire(now, [&r, now](detail::timer_entry& entry)
+                {
+                    const auto late = std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - r.timed_events_.deadline(entry));
+                    record(r.timer_lateness_, static_cast<uint64_t>(std::max<int64_t>(late.count(), 0)));
+                    r.timed_out_.emplace_back(static_cast<detail::poll_info*>(&entry));
+                });
+
+        // The timerfd fired, whatever it was armed for has passed.
+        r.armed_deadline_ = time_point::max();
+    }
+
+    for (auto pi : r.timed_out_)
+    {
+        if (pi->slot_ != nullptr)
+        {
+            // A registered fd's waiter belongs to whoever empties its slot.
+            auto* expected = pi;
+            if (pi->slot_->compare_exchange_strong(expected, nullptr, std::memory_order::seq_cst))
+            {
+                wait_published(*pi);
+                pi->processed_ = true;
+                pi->poll_status_ = PollStatus::TIMEOUT;
+                resume_poll(r, *pi);
+            }
+        }
+        else if (!pi->processed_)
+        {
+            wait_published(*pi);
+            pi->processed_ = true;
+            pi->poll_status_ = PollStatus::TIMEOUT;
+
+            // Since this timed out, remove its corresponding event if it has one.
+            if (disarm_poll(r, *pi))
+            {
+                resume_poll(r, *pi);
+            }
+        }
+    }
+    r.timed_out_.clear();
+
+    // Resuming may have shifted the time, re-take it for the next deadline.
+    std::scoped_lock lk{r.timed_events_mtx_};
+    update_timeout(r, clock::now());
+}
+
+void IOScheduler::add_timer_token(reactor& r, time_point tp, detail::poll_info& pi, std::chrono::milliseconds slack)
+{
+    // A timer may fire anywhere in [tp, tp + slack]. It expires on the last
+    // multiple of slack's power of two floor in that window, so timers with
+    // nearby deadlines and similar slack share one expiry.
+    auto expiry = tp;
+    if (slack > 0ms)
+    {
+        const auto granularity = static_cast<std::chrono::milliseconds::rep>(
+            std::bit_floor(static_cast<uint64_t>(slack.count())));
+        auto latest = std::chrono::floor<std::chrono::milliseconds>((tp + slack).time_since_epoch()).count();
+        latest -= latest % granularity;
+        expiry = std::max(tp, time_point{std::chrono::milliseconds{latest}});
+    }
+
+    std::scoped_lock lk{r.timed_events_mtx_};
+    r.timed_events_.insert(pi, expiry);
+
+    // Only a deadline earlier than the armed one needs the timerfd moved.
+    auto next = r.timed_events_.next_deadline();
+    if (next < r.armed_deadline_)
+    {
+        update_timeout(r, clock::now());
+    }
+    else if (r.timed_events_.due_time(tp) < r.armed_deadline_)
+    {
+        // Without its slack this timer would have moved it.
+        bump(r.timer_rearms_avoided_);
+    }
+}
+
+void IOScheduler::remove_timer_token(reactor& r, detail::poll_info& pi)
+{
+    // The timerfd is left alone, a stale expiry finds nothing due and re-arms
+    // for the real next deadline.
+    std::scoped_lock lk{r.timed_events_mtx_};
+    r.timed_events_.remove(pi);
+}
+
+void IOScheduler::update_timeout(reactor& r, time_point now)
+{
+    itimerspec ts{};
+
+    auto next = r.timed_events_.next_deadline();
+    r.armed_deadline_ = next.value_or(time_point::max());
+    bump(r.timer_rearms_);
+
+    if (next.has_value())
+    {
+        auto amount = *next - now;
+
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(amount);
+        amount -= seconds;
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(amount);
+
+        // Zero disarms a timerfd and negative values are an error, fire
+        // "immediately" instead.
+        if (seconds <= 0s)
+        {
+            seconds = 0s;
+            if (nanoseconds <= 0ns)
+            {
+                nanoseconds = 1ns;
+            }
+        }
+
+        ts.it_value.tv_sec = seconds.count();
+        ts.it_value.tv_nsec = nanoseconds.count();
+    }
+
+    // An all zero itimerspec disarms the timer.
+    // Only a broken timerfd fails here, its deadlines would never fire.
+    if (timerfd_settime(r.timer_fd_, 0, &ts, nullptr) == -1)
+    {
+        throw std::runtime_error{"Failed to set timerfd errno=[" + std::string{strerror(errno)} + "]"};
+    }
+}
+
+void IOScheduler::submit_file(reactor& r, file_request& request)
+{
+    if (r.uring_ == nullptr)
+    {
+        offload_file(request);
+        return;
+    }
+
+    std::scoped_lock lk{r.uring_mtx_};
+    auto& sqe = next_sqe(r);
+    sqe.fd = request.fd_;
+    sqe.off = static_cast<uint64_t>(request.offset_);
+    switch (request.op_)
+    {
+        case FileOp::READ:
+        case FileOp::WRITE:
+            sqe.opcode = (request.op_ == FileOp::READ) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe.addr = reinterpret_cast<uint64_t>(request.buffer_);
+            // Longer transfers come back short, as they would from pread().
+            sqe.len = static_cast<uint32_t>(std::min<std::size_t>(request.size_, UINT32_MAX));
+            break;
+        case FileOp::FSYNC:
+        case FileOp::FDATASYNC:
+            sqe.opcode = IORING_OP_FSYNC;
+            sqe.fsync_flags = (request.op_ == FileOp::FDATASYNC) ? IORING_FSYNC_DATASYNC : 0;
+            break;
+        case FileOp::FALLOCATE:
+            // The length travels in addr and the mode in len.
+            sqe.opcode = IORING_OP_FALLOCATE;
+            sqe.addr = static_cast<uint64_t>(request.size_);
+            sqe.len = static_cast<uint32_t>(request.mode_);
+            break;
+    }
+    sqe.user_data = reinterpret_cast<uintptr_t>(&request) | file_tag_;
+    submit_sqes(r);
+}
+
+void IOScheduler::offload_file(file_request& request)
+{
+    std::unique_lock lk{file_mtx_};
+    if (file_stop_) [[unlikely]]
+    {
+        // The pool is gone after shutdown, block the caller instead.
+        lk.unlock();
+        request.result_ = execute_file(request);
+        complete_file(request);
+        return;
+    }
+
+    request.next_ = nullptr;
+    if (file_tail_ != nullptr)
+    {
+        file_tail_->next_ = &request;
+    }
+    else
+    {
+        file_head_ = &request;
+    }
+    file_tail_ = &request;
+    ++file_queued_;
+
+    // Another thread is only started when the idle ones cannot take the queue.
+    if (file_queued_ > file_idle_ && file_threads_.size() < std::max<std::size_t>(opts_.file_threads, 1))
+    {
+        file_threads_.emplace_back([this]()
+                {
+                    process_files_offloaded();
+                });
+    }
+    else
+    {
+        file_cv_.notify_one();
+    }
+}
+
+void IOScheduler::process_files_offloaded()
+{
+    std::unique_lock lk{file_mtx_};
+    while (true)
+    {
+        while (file_head_ == nullptr && !file_stop_)
+        {
+            ++file_idle_;
+            file_cv_.wait(lk);
+            --file_idle_;
+        }
+
+        // Stopping waits for the queue to drain.
+        if (file_head_ == nullptr)
+        {
+            return;
+        }
+
+        auto* request = file_head_;
+        file_head_ = request->next_;
+        if (file_head_ == nullptr)
+        {
+            file_tail_ = nullptr;
+        }
+        --file_queued_;
+        lk.unlock();
+
+        request->result_ = execute_file(*request);
+        complete_file(*request);
+
+        lk.lock();
+    }
+}
+
+void IOScheduler::complete_file(file_request& request)
+{
+    // The reactor would only pass the coroutine on to the thread pool.
+    if (!queues_inline())
+    {
+        thread_pool_->resume(request.awaiting_coroutine_);
+        return;
+    }
+
+    // Once pushed the io thread may resume the coroutine and free the
+    // request, only the reactor is touched after that.
+    auto& r = *request.reactor_;
+    r.files_done_.push(request);
+    wake_inline(r);
+}
+
+int64_t IOScheduler::execute_file(const file_request& request) noexcept
+{
+    int64_t result{0};
+    do
+    {
+        switch (request.op_)
+        {
+            case FileOp::READ:
+                result = ::pread(request.fd_, request.buffer_, request.size_, request.offset_);
+                break;
+            case FileOp::WRITE:
+                result = ::pwrite(request.fd_, request.buffer_, request.size_, request.offset_);
+                break;
+            case FileOp::FSYNC:
+                result = ::fsync(request.fd_);
+                break;
+            case FileOp::FDATASYNC:
+                result = ::fdatasync(request.fd_);
+                break;
+            case FileOp::FALLOCATE:
+                result = ::fallocate(request.fd_, request.mode_, request.offset_, static_cast<off_t>(request.size_));
+                break;
+        }
+    }
+    while (result == -1 && errno == EINTR);
+
+    // Report errors the way io_uring completions do.
+    return result == -1 ? -errno : result;
+}
+
+void IOScheduler::process_files_done_execute(reactor& r)
+{
+    for (auto* request = r.files_done_.take_all(); request != nullptr;)
+    {
+        auto handle = request->awaiting_coroutine_;
+        request = request->next_;
+        r.handles_to_resume_.emplace_back(handle);
+    }
+}
+
+void IOScheduler::stop_file_threads() noexcept
+{
+    // No thread is started once file_stop_ is set.
+    std::vector<std::thread> threads{};
+    {
+        std::scoped_lock lk{file_mtx_};
+        file_stop_ = true;
+        threads.swap(file_threads_);
+    }
+    file_cv_.notify_all();
+
+    for (auto& thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+} // namespace coro
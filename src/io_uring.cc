@@ -0,0 +1,157 @@
+#include <detail/io_uring.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace coro::detail
+{
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "ring indexes are shared with the kernel");
+
+std::unique_ptr<io_uring> io_uring::create(uint32_t entries) noexcept
+{
+    io_uring_params params{};
+    const int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<io_uring> ring{new (std::nothrow) io_uring{}};
+    if (ring == nullptr)
+    {
+        close(fd);
+        return nullptr;
+    }
+    ring->ring_fd_ = fd;
+
+    // A timeout on io_uring_enter() needs EXT_ARG (5.11), which implies SINGLE_MMAP.
+    const uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((params.features & required) != required)
+    {
+        return nullptr;
+    }
+
+    ring->ring_size_ = std::max<std::size_t>(
+            params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ring->ring_ptr_ = mmap(nullptr, ring->ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr_ == MAP_FAILED)
+    {
+        ring->ring_ptr_ = nullptr;
+        return nullptr;
+    }
+
+    ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    ring->sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto* base = static_cast<char*>(ring->ring_ptr_);
+    ring->sq_head_ = reinterpret_cast<std::atomic<uint32_t>*>(base + params.sq_off.head);
+    ring->sq_tail_ = reinterpret_cast<std::atomic<uint32_t>*>(base + params.sq_off.tail);
+    ring->sq_mask_ = *reinterpret_cast<uint32_t*>(base + params.sq_off.ring_mask);
+    ring->sq_entries_ = params.sq_entries;
+    ring->cq_head_ = reinterpret_cast<std::atomic<uint32_t>*>(base + params.cq_off.head);
+    ring->cq_tail_ = reinterpret_cast<std::atomic<uint32_t>*>(base + params.cq_off.tail);
+    ring->cq_mask_ = *reinterpret_cast<uint32_t*>(base + params.cq_off.ring_mask);
+    ring->cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+    // Submission slot i always refers to entry i, get_sqe() hands them out in order.
+    auto* array = reinterpret_cast<uint32_t*>(base + params.sq_off.array);
+    for (uint32_t i = 0; i < params.sq_entries; ++i)
+    {
+        array[i] = i;
+    }
+
+    // Multishot polls and resource tags both arrived in 5.13, the feature bit
+    // saves probing the opcode.
+    ring->multishot_poll_ = (params.features & IORING_FEAT_RSRC_TAGS) != 0;
+
+    ring->sqe_tail_ = ring->sq_tail_->load(std::memory_order::relaxed);
+    return ring;
+}
+
+io_uring::~io_uring()
+{
+    if (sqes_ != nullptr)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+
+    if (ring_ptr_ != nullptr)
+    {
+        munmap(ring_ptr_, ring_size_);
+    }
+
+    if (ring_fd_ != -1)
+    {
+        close(ring_fd_);
+    }
+}
+
+io_uring_sqe* io_uring::get_sqe() noexcept
+{
+    const uint32_t head = sq_head_->load(std::memory_order::acquire);
+    if (sqe_tail_ - head >= sq_entries_)
+    {
+        return nullptr;
+    }
+
+    io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    ++sqe_tail_;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+uint32_t io_uring::publish() noexcept
+{
+    sq_tail_->store(sqe_tail_, std::memory_order::release);
+    return sqe_tail_ - sq_head_->load(std::memory_order::acquire);
+}
+
+int io_uring::submit() noexcept
+{
+    const uint32_t pending = publish();
+    if (pending == 0)
+    {
+        return 0;
+    }
+
+    int ret{0};
+    do
+    {
+        ret = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, pending, 0, 0, nullptr, 0));
+    }
+    while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? -errno : ret;
+}
+
+void io_uring::wait(const timespec* timeout, uint32_t to_submit) noexcept
+{
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout != nullptr)
+    {
+        ts.tv_sec = timeout->tv_sec;
+        ts.tv_nsec = timeout->tv_nsec;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    // ETIME and EINTR both just mean there is nothing to reap yet. Entries
+    // another thread submitted meanwhile make the enter return without
+    // waiting, the caller simply loops.
+    syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+} // namespace coro::detail
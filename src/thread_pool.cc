@@ -1,11 +1,23 @@
 #include <thread_pool.h>
+#include <detail/cpu_topology.h>
 
+#include <algorithm>
+#include <bit>
 #include <iostream>
 
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 namespace coro
 {
-ThreadPool::operation::operation(ThreadPool& tp) noexcept
+thread_local ThreadPool::worker* ThreadPool::current_worker_{nullptr};
+
+ThreadPool::operation::operation(ThreadPool& tp, Priority priority) noexcept
     : thread_pool_(tp)
+    , priority_(priority)
 {
 
 }
@@ -13,40 +25,318 @@ ThreadPool::operation::operation(ThreadPool& tp) noexcept
 void ThreadPool::operation::await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept
 {
     awaiting_coroutine_ = awaiting_coroutine;
-    thread_pool_._schedule(awaiting_coroutine);
+    if (!thread_pool_.throttle(*this))
+    {
+        thread_pool_._schedule(awaiting_coroutine, priority_);
+    }
+}
+
+ThreadPool::blocking_region::blocking_region(ThreadPool& tp) noexcept
+    : thread_pool_(tp)
+{
+    worker* w = tp.local_worker();
+    if (w == nullptr)
+    {
+        return;
+    }
+
+    counted_ = true;
+    tp.blocked_.fetch_add(1, std::memory_order::seq_cst);
+
+    // Handles queued on this worker can only be reached by thieves now.
+    tp.flush_lifo_slot(*w);
+    std::size_t local_depth{0};
+    for (const auto& q : w->local_queues_)
+    {
+        local_depth += q.size();
+    }
+    if (local_depth > 0)
+    {
+        tp.notify_workers(local_depth);
+    }
+
+    tp.compensate();
+}
+
+ThreadPool::blocking_region::~blocking_region()
+{
+    if (counted_)
+    {
+        thread_pool_.blocked_.fetch_sub(1, std::memory_order::seq_cst);
+    }
 }
 
 ThreadPool::ThreadPool(options opts)
     : opts_(std::move(opts))
 {
-    threads_.reserve(opts_.thread_count);
+    opts_.max_thread_count = std::max(opts_.max_thread_count, opts_.thread_count);
+    if (opts_.low_water_mark == 0 || opts_.low_water_mark > opts_.high_water_mark)
+    {
+        opts_.low_water_mark = std::max<std::size_t>(opts_.high_water_mark / 2, 1);
+    }
+
+    workers_.reserve(opts_.max_thread_count);
+    threads_.resize(opts_.max_thread_count);
+    idle_workers_.reserve(opts_.max_thread_count);
 
+    for (auto& weight : opts_.priority_weights)
+    {
+        weight = std::max<uint32_t>(weight, 1);
+    }
+
+    place_workers();
+
+    opts_.execute_nodes = std::max<std::size_t>(opts_.execute_nodes, 1);
+    execute_slab_ = std::make_unique<execute_node[]>(opts_.execute_nodes);
+    free_nodes_ = std::make_unique<detail::mpmc_ring<execute_node*>>(opts_.execute_nodes);
+    for (std::size_t i = 0; i < opts_.execute_nodes; ++i)
+    {
+        free_nodes_->try_push(&execute_slab_[i]);
+    }
+
+    std::scoped_lock lk{elastic_mtx_};
     for (uint32_t i = 0; i < opts_.thread_count; ++i)
     {
-        threads_.emplace_back([this, i](std::stop_token st)
-                {
-                    executor(std::move(st), i);
-                });
+        start_worker(i);
     }
 }
 
 ThreadPool::~ThreadPool()
 {
     shutdown();
+
+    auto free_node = [this](execute_node* node)
+    {
+        if (!slab_node(node))
+        {
+            delete node;
+        }
+    };
+
+    for (auto& w : workers_)
+    {
+        std::for_each(w->node_cache_.begin(), w->node_cache_.end(), free_node);
+    }
+    while (auto node = free_nodes_->try_pop())
+    {
+        free_node(*node);
+    }
+}
+
+void ThreadPool::place_workers()
+{
+    const uint32_t count = opts_.thread_count;
+    const uint32_t total = opts_.max_thread_count;
+    std::vector<thread_info> infos(total);
+    // Topology node index per worker, -1 when unplaced.
+    std::vector<int32_t> topo_nodes(total, -1);
+    detail::cpu_topology topology{};
+
+    for (uint32_t i = 0; i < total; ++i)
+    {
+        infos[i].idx = i;
+    }
+
+    if (opts_.affinity == Affinity::CPU_SET)
+    {
+        if (opts_.cpus.empty())
+        {
+            throw std::runtime_error("coro::ThreadPool Affinity::CPU_SET requires a non empty options::cpus");
+        }
+
+        topology = detail::cpu_topology::discover();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t cpu = opts_.cpus[i % opts_.cpus.size()];
+            infos[i].cpu = static_cast<int32_t>(cpu);
+            topo_nodes[i] = std::max(topology.node_of(cpu), 0);
+            infos[i].node = static_cast<int32_t>(topology.nodes[topo_nodes[i]].id);
+        }
+    }
+    else if (opts_.affinity == Affinity::NUMA)
+    {
+        topology = detail::cpu_topology::discover();
+        if (!opts_.cpus.empty())
+        {
+            for (auto& n : topology.nodes)
+            {
+                std::erase_if(n.cpus, [this](uint32_t cpu)
+                        {
+                            return std::find(opts_.cpus.begin(), opts_.cpus.end(), cpu) == opts_.cpus.end();
+                        });
+            }
+            std::erase_if(topology.nodes, [](const detail::cpu_topology::node& n)
+                    {
+                        return n.cpus.empty();
+                    });
+        }
+
+        if (topology.nodes.empty())
+        {
+            throw std::runtime_error("coro::ThreadPool Affinity::NUMA found no usable cpus");
+        }
+
+        const std::size_t node_count = std::min<std::size_t>(topology.nodes.size(), std::max(count, 1u));
+        uint32_t first_in_node{0};
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const std::size_t k = static_cast<std::size_t>(i) * node_count / count;
+            if (i == 0 || k != static_cast<std::size_t>(topo_nodes[i - 1]))
+            {
+                first_in_node = i;
+            }
+
+            const auto& cpus = topology.nodes[k].cpus;
+            topo_nodes[i] = static_cast<int32_t>(k);
+            infos[i].cpu = static_cast<int32_t>(cpus[(i - first_in_node) % cpus.size()]);
+            infos[i].node = static_cast<int32_t>(topology.nodes[k].id);
+        }
+    }
+
+    // Spares stand in for a blocked worker, so they mirror the core layout.
+    for (uint32_t i = count; i < total && count > 0; ++i)
+    {
+        infos[i].cpu = infos[i % count].cpu;
+        infos[i].node = infos[i % count].node;
+        topo_nodes[i] = topo_nodes[i % count];
+    }
+
+    // Dense node indexes, only for topology nodes that actually got workers.
+    std::vector<int32_t> dense(std::max<std::size_t>(topology.nodes.size(), 1), -1);
+    std::size_t dense_count{0};
+    for (uint32_t i = 0; i < total; ++i)
+    {
+        const auto t = static_cast<std::size_t>(std::max(topo_nodes[i], 0));
+        if (dense[t] == -1)
+        {
+            dense[t] = static_cast<int32_t>(dense_count++);
+        }
+    }
+    dense_count = std::max<std::size_t>(dense_count, 1);
+
+    injection_.reserve(dense_count);
+    node_workers_.resize(dense_count);
+    for (std::size_t i = 0; i < dense_count; ++i)
+    {
+        injection_.emplace_back(std::make_unique<injection_queue>(opts_.injection_capacity));
+    }
+
+    for (uint32_t i = 0; i < total; ++i)
+    {
+        const auto node_idx = static_cast<std::size_t>(dense[std::max(topo_nodes[i], 0)]);
+        workers_.emplace_back(std::make_unique<worker>(*this, infos[i], node_idx));
+        workers_.back()->credits_ = opts_.priority_weights;
+        node_workers_[node_idx].push_back(workers_.back().get());
+    }
+
+    if (opts_.affinity != Affinity::NONE)
+    {
+        for (std::size_t t = 0; t < topology.nodes.size(); ++t)
+        {
+            for (uint32_t cpu : topology.nodes[t].cpus)
+            {
+                if (cpu >= cpu_to_node_.size())
+                {
+                    cpu_to_node_.resize(cpu + 1, 0);
+                }
+                cpu_to_node_[cpu] = dense[t] >= 0 ? static_cast<std::size_t>(dense[t]) : t % dense_count;
+            }
+        }
+    }
 }
 
-ThreadPool::operation ThreadPool::schedule()
+bool ThreadPool::start_worker(std::size_t idx)
+{
+    worker& w = *workers_[idx];
+    auto& thread = threads_[idx];
+    // A retired thread clears running_ as its very last step, joining is quick.
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+
+    w.running_ = true;
+    live_.fetch_add(1, std::memory_order::seq_cst);
+    try
+    {
+        thread = std::jthread{[this, &w](std::stop_token st)
+                {
+                    executor(std::move(st), w);
+                }};
+    }
+    catch (...)
+    {
+        w.running_ = false;
+        live_.fetch_sub(1, std::memory_order::seq_cst);
+        if (idx < opts_.thread_count)
+        {
+            throw;
+        }
+        return false;
+    }
+    return true;
+}
+
+void ThreadPool::compensate() noexcept
+{
+    if (opts_.max_thread_count <= opts_.thread_count)
+    {
+        return;
+    }
+
+    // Core workers never retire, only spare slots can be free.
+    std::scoped_lock lk{elastic_mtx_};
+    while (!shutdown_requested_.load(std::memory_order::acquire)
+            && live_.load(std::memory_order::seq_cst) - blocked_.load(std::memory_order::seq_cst) < opts_.thread_count)
+    {
+        auto free_slot = std::find_if(workers_.begin() + opts_.thread_count, workers_.end(), [](const auto& w)
+                {
+                    return !w->running_;
+                });
+        if (free_slot == workers_.end() || !start_worker(free_slot - workers_.begin()))
+        {
+            return;
+        }
+    }
+}
+
+ThreadPool::injection_queue& ThreadPool::caller_injection_queue() noexcept
+{
+    if (injection_.size() > 1)
+    {
+        const int cpu = sched_getcpu();
+        if (cpu >= 0 && static_cast<std::size_t>(cpu) < cpu_to_node_.size())
+        {
+            return *injection_[cpu_to_node_[cpu]];
+        }
+    }
+    return *injection_.front();
+}
+
+void ThreadPool::inject(injection_queue& iq, std::size_t cls, queued_handle item)
+{
+    if (iq.overflowed_[cls].load(std::memory_order::acquire) == 0 && iq.rings_[cls]->try_push(item))
+    {
+        return;
+    }
+
+    std::scoped_lock lk{iq.overflow_mtx_};
+    iq.overflow_[cls].emplace_back(item);
+    iq.overflowed_[cls].fetch_add(1, std::memory_order::release);
+}
+
+ThreadPool::operation ThreadPool::schedule(Priority priority)
 {
     if (!shutdown_requested_.load(std::memory_order::relaxed))
     {
         size_.fetch_add(1, std::memory_order::release);
-        return operation{*this};
+        return operation{*this, priority};
     }
 
     throw std::runtime_error("coro::ThreadPool is shutting down, unable to schedule new tasks");
 }
 
-void ThreadPool::resume(std::coroutine_handle<> handle) noexcept
+void ThreadPool::resume(std::coroutine_handle<> handle, Priority priority) noexcept
 {
     if (handle == nullptr)
     {
@@ -54,18 +344,36 @@ void ThreadPool::resume(std::coroutine_handle<> handle) noexcept
     }
 
     size_.fetch_add(1, std::memory_order::release);
-    _schedule(handle);
+    _schedule(handle, priority, true);
+}
+
+bool ThreadPool::try_resume(std::coroutine_handle<> handle, Priority priority) noexcept
+{
+    if (above_high_water())
+    {
+        return false;
+    }
+
+    resume(handle, priority);
+    return true;
 }
 
 void ThreadPool::shutdown() noexcept
 {
     if (shutdown_requested_.exchange(true, std::memory_order::acq_rel) == false)
     {
-        for (auto& thread : threads_)
+        // compensate() re-checks shutdown_requested_ under this lock, no
+        // spare can start after it has been released.
         {
-            thread.request_stop();
+            std::scoped_lock lk{elastic_mtx_};
+            for (auto& thread : threads_)
+            {
+                thread.request_stop();
+            }
         }
 
+        unpark_all();
+
         for (auto& thread : threads_)
         {
             if (thread.joinable())
@@ -76,57 +384,660 @@ void ThreadPool::shutdown() noexcept
     }
 }
 
-void ThreadPool::executor(std::stop_token st, std::size_t idx)
+void ThreadPool::executor(std::stop_token st, worker& w)
 {
+    current_worker_ = &w;
+
+    if (w.info_.cpu >= 0 && !detail::pin_current_thread(static_cast<uint32_t>(w.info_.cpu)))
+    {
+        w.info_.cpu = -1;
+    }
+
     if (opts_.on_thread_start_functor != nullptr)
     {
-        opts_.on_thread_start_functor(idx);
+        opts_.on_thread_start_functor(w.info_);
     }
 
-    while (!st.stop_requested())
+    w.counters_.since_ns_.store(now_ns(), std::memory_order::relaxed);
+
+    while (true)
     {
-        while (true)
+        auto item = next_handle(w);
+        if (item.has_value())
         {
-            std::unique_lock<std::mutex> lock{wait_mtx_};
-            wait_cv_.wait(lock, st, [this]
-                    {
-                        return !queue_.empty();
-                    });
-            if (queue_.empty())
+            if (item->enqueued_ns_ != 0)
             {
-                lock.unlock();
-                break;
+                const uint64_t now = now_ns();
+                const uint64_t waited = now > item->enqueued_ns_ ? now - item->enqueued_ns_ : 0;
+                const auto bucket = std::min<std::size_t>(std::bit_width(waited), queue_wait_buckets - 1);
+                bump(w.counters_.queue_wait_[bucket]);
             }
 
-            auto handle = queue_.front();
-            queue_.pop_front();
+            run(*item);
+            bump(w.counters_.tasks_executed_);
+            size_.fetch_sub(1, std::memory_order::release);
+            continue;
+        }
 
-            lock.unlock();
+        // Drain everything reachable before honouring a stop request.
+        if (st.stop_requested())
+        {
+            break;
+        }
 
-            handle.resume();
-            size_.fetch_sub(1, std::memory_order::release);
+        account(w, true);
+        if (!wait_for_work(st, w))
+        {
+            break;
         }
+        account(w, false);
     }
 
+    account(w, true);
+
     if (opts_.on_thread_stop_functor != nullptr)
     {
-        opts_.on_thread_stop_functor(idx);
+        opts_.on_thread_stop_functor(w.info_);
+    }
+
+    current_worker_ = nullptr;
+
+    std::scoped_lock lk{elastic_mtx_};
+    w.running_ = false;
+}
+
+void ThreadPool::run(const queued_handle& item) noexcept
+{
+    if ((item.item_ & execute_tag) != 0)
+    {
+        auto* node = reinterpret_cast<execute_node*>(item.item_ & ~execute_tag);
+        node->invoke_(*node);
+        release_node(node);
+        return;
+    }
+
+    std::coroutine_handle<>::from_address(reinterpret_cast<void*>(item.item_)).resume();
+}
+
+ThreadPool::execute_node* ThreadPool::acquire_node()
+{
+    if (worker* w = local_worker(); w != nullptr && !w->node_cache_.empty())
+    {
+        execute_node* node = w->node_cache_.back();
+        w->node_cache_.pop_back();
+        return node;
+    }
+
+    if (auto node = free_nodes_->try_pop(); node.has_value())
+    {
+        return *node;
+    }
+
+    return new execute_node{};
+}
+
+void ThreadPool::release_node(execute_node* node) noexcept
+{
+    // Enough to absorb a burst submitted and run on the same worker.
+    constexpr std::size_t node_cache_size{64};
+
+    if (worker* w = local_worker(); w != nullptr && w->node_cache_.size() < node_cache_size)
+    {
+        w->node_cache_.push_back(node);
+        return;
+    }
+
+    if (!free_nodes_->try_push(node) && !slab_node(node))
+    {
+        delete node;
+    }
+}
+
+void ThreadPool::account(worker& w, bool idle) noexcept
+{
+    auto& c = w.counters_;
+    const uint64_t now = now_ns();
+    const uint64_t elapsed = now - c.since_ns_.load(std::memory_order::relaxed);
+    bump(idle ? c.busy_ns_ : c.idle_ns_, elapsed);
+    c.since_ns_.store(now, std::memory_order::relaxed);
+    c.idle_.store(idle, std::memory_order::relaxed);
+}
+
+ThreadPool::metrics_snapshot ThreadPool::metrics() const
+{
+    metrics_snapshot snapshot{};
+    snapshot.workers.reserve(workers_.size());
+    const uint64_t now = now_ns();
+
+    for (const auto& w : workers_)
+    {
+        const auto& c = w->counters_;
+        uint64_t busy = c.busy_ns_.load(std::memory_order::relaxed);
+        uint64_t idle = c.idle_ns_.load(std::memory_order::relaxed);
+        const uint64_t since = c.since_ns_.load(std::memory_order::relaxed);
+        const uint64_t current = (since != 0 && now > since) ? now - since : 0;
+        (c.idle_.load(std::memory_order::relaxed) ? idle : busy) += current;
+
+        std::size_t local_depth{0};
+        for (const auto& q : w->local_queues_)
+        {
+            local_depth += q.size();
+        }
+
+        snapshot.workers.emplace_back(worker_metrics{
+            .idx = w->info_.idx,
+            .tasks_executed = c.tasks_executed_.load(std::memory_order::relaxed),
+            .steals = c.steals_.load(std::memory_order::relaxed),
+            .busy = std::chrono::nanoseconds{busy},
+            .idle = std::chrono::nanoseconds{idle},
+            .local_queue_depth = local_depth});
+
+        for (std::size_t i = 0; i < queue_wait_buckets; ++i)
+        {
+            snapshot.queue_wait_histogram[i] += c.queue_wait_[i].load(std::memory_order::relaxed);
+        }
+    }
+
+    for (std::size_t cls = 0; cls < priority_count; ++cls)
+    {
+        snapshot.queue_depth[cls] = queued(cls);
+    }
+
+    snapshot.live_workers = live_.load(std::memory_order::acquire);
+    snapshot.blocked_workers = blocked_.load(std::memory_order::acquire);
+    snapshot.throttled = throttled_count_.load(std::memory_order::acquire);
+
+    return snapshot;
+}
+
+std::size_t ThreadPool::queued(std::size_t cls) const noexcept
+{
+    std::size_t total{0};
+    for (const auto& w : workers_)
+    {
+        total += w->local_queues_[cls].size();
+    }
+    for (const auto& iq : injection_)
+    {
+        total += iq->rings_[cls]->size() + iq->overflowed_[cls].load(std::memory_order::acquire);
+    }
+    return total;
+}
+
+std::size_t ThreadPool::queue_size() const noexcept
+{
+    std::size_t total{0};
+    for (std::size_t cls = 0; cls < priority_count; ++cls)
+    {
+        total += queued(cls);
+    }
+    return total;
+}
+
+std::size_t ThreadPool::queue_size(Priority priority) const noexcept
+{
+    return queued(static_cast<std::size_t>(priority));
+}
+
+bool ThreadPool::has_queued() const noexcept
+{
+    for (const auto& iq : injection_)
+    {
+        for (std::size_t cls = 0; cls < priority_count; ++cls)
+        {
+            if (!iq->rings_[cls]->empty() || iq->overflowed_[cls].load(std::memory_order::acquire) > 0)
+            {
+                return true;
+            }
+        }
+    }
+
+    return std::any_of(workers_.begin(), workers_.end(), [](const auto& w)
+            {
+                return std::any_of(w->local_queues_.begin(), w->local_queues_.end(), [](const auto& q)
+                        {
+                            return !q.empty();
+                        });
+            });
+}
+
+std::optional<ThreadPool::queued_handle> ThreadPool::next_handle(worker& w) noexcept
+{
+    if (w.lifo_slot_.has_value())
+    {
+        if (w.lifo_runs_ < opts_.lifo_budget)
+        {
+            ++w.lifo_runs_;
+            auto handle = w.lifo_slot_;
+            w.lifo_slot_.reset();
+            return handle;
+        }
+
+        // A ping-pong pair used up its budget, let older work run first.
+        flush_lifo_slot(w);
+    }
+    w.lifo_runs_ = 0;
+
+    // Weighted round robin: a class is served while it has credits left, once
+    // every non-empty class ran out the credits are refilled. The second pass
+    // only happens after a refill so a lone backlogged class is never stuck.
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (std::size_t cls = 0; cls < priority_count; ++cls)
+        {
+            if (w.credits_[cls] == 0)
+            {
+                continue;
+            }
+
+            if (auto handle = take(w, cls); handle.has_value())
+            {
+                --w.credits_[cls];
+                return handle;
+            }
+        }
+
+        w.credits_ = opts_.priority_weights;
+    }
+
+    return steal(w);
+}
+
+void ThreadPool::flush_lifo_slot(worker& w) noexcept
+{
+    if (!w.lifo_slot_.has_value())
+    {
+        return;
+    }
+
+    w.local_queues_[w.lifo_cls_].push(*w.lifo_slot_);
+    w.lifo_slot_.reset();
+    notify_workers();
+}
+
+std::optional<ThreadPool::queued_handle> ThreadPool::take(worker& w, std::size_t cls) noexcept
+{
+    if (auto handle = w.local_queues_[cls].pop(); handle.has_value())
+    {
+        dequeued();
+        return handle;
     }
+
+    return take_injected(*injection_[w.node_idx_], cls);
+}
+
+std::optional<ThreadPool::queued_handle> ThreadPool::take_injected(injection_queue& iq, std::size_t cls) noexcept
+{
+    auto& ring = *iq.rings_[cls];
+    std::optional<queued_handle> handle = ring.try_pop();
+    bool more{false};
+
+    if (handle.has_value())
+    {
+        more = !ring.empty();
+    }
+    else if (iq.overflowed_[cls].load(std::memory_order::acquire) > 0)
+    {
+        std::scoped_lock lk{iq.overflow_mtx_};
+        auto& overflow = iq.overflow_[cls];
+        if (!overflow.empty())
+        {
+            handle = overflow.front();
+            overflow.pop_front();
+            iq.overflowed_[cls].fetch_sub(1, std::memory_order::release);
+            more = !overflow.empty();
+        }
+    }
+
+    if (handle.has_value())
+    {
+        dequeued();
+        if (more)
+        {
+            notify_workers();
+        }
+    }
+    return handle;
+}
+
+std::optional<ThreadPool::queued_handle> ThreadPool::steal(worker& w) noexcept
+{
+    // xorshift32, picks a random first victim so thieves spread out.
+    w.rng_state_ ^= w.rng_state_ << 13;
+    w.rng_state_ ^= w.rng_state_ >> 17;
+    w.rng_state_ ^= w.rng_state_ << 5;
+
+    const std::size_t node_count = node_workers_.size();
+
+    for (std::size_t cls = 0; cls < priority_count; ++cls)
+    {
+        auto& dst = w.local_queues_[cls];
+
+        // Own node first, then the other nodes' injection queues and workers.
+        for (std::size_t n = 0; n < node_count; ++n)
+        {
+            const std::size_t node = (w.node_idx_ + n) % node_count;
+            if (n > 0)
+            {
+                if (auto handle = take_injected(*injection_[node], cls); handle.has_value())
+                {
+                    return handle;
+                }
+            }
+
+            const auto& peers = node_workers_[node];
+            const std::size_t start = w.rng_state_ % peers.size();
+            for (std::size_t i = 0; i < peers.size(); ++i)
+            {
+                worker* victim = peers[(start + i) % peers.size()];
+                if (victim == &w)
+                {
+                    continue;
+                }
+
+                if (auto handle = victim->local_queues_[cls].steal_into(dst); handle.has_value())
+                {
+                    dequeued();
+                    bump(w.counters_.steals_);
+                    // Let another sleeper come and take from the batch just stolen.
+                    if (!dst.empty())
+                    {
+                        notify_workers();
+                    }
+                    return handle;
+                }
+            }
+        }
+    }
+
+    return std::nullopt;
 }
 
-void ThreadPool::_schedule(std::coroutine_handle<> handle) noexcept
+bool ThreadPool::wait_for_work(std::stop_token& st, worker& w)
+{
+    for (uint32_t i = 0; i < opts_.idle.spin_rounds; ++i)
+    {
+        if (has_queued() || st.stop_requested())
+        {
+            return true;
+        }
+
+        for (uint32_t j = 0; j < 32; ++j)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+    }
+
+    for (uint32_t i = 0; i < opts_.idle.yield_rounds; ++i)
+    {
+        if (has_queued() || st.stop_requested())
+        {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+
+    return park(st, w);
+}
+
+bool ThreadPool::park(std::stop_token& st, worker& w)
+{
+    w.futex_word_.store(0, std::memory_order::relaxed);
+    {
+        std::scoped_lock lk{idle_mtx_};
+        idle_workers_.push_back(&w);
+    }
+
+    // Dekker style handshake with notify_workers(): either the producer sees
+    // this worker in sleeping_ or this worker sees the handle it queued.
+    sleeping_.fetch_add(1, std::memory_order::seq_cst);
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    if (!has_queued() && !st.stop_requested())
+    {
+        // Only spares wait with a timeout, core workers stay for good.
+        if (w.info_.idx < opts_.thread_count)
+        {
+            while (w.futex_word_.load(std::memory_order::acquire) == 0)
+            {
+                detail::futex_wait(w.futex_word_, 0);
+            }
+            return true;
+        }
+
+        const auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(opts_.spare_idle_timeout);
+        auto deadline = clock::now() + timeout;
+        while (w.futex_word_.load(std::memory_order::acquire) == 0)
+        {
+            const auto left = std::max(deadline - clock::now(), clock::duration::zero());
+            const auto secs = std::chrono::duration_cast<std::chrono::seconds>(left);
+            const timespec ts{
+                .tv_sec = static_cast<time_t>(secs.count()),
+                .tv_nsec = static_cast<long>((left - secs).count())};
+            detail::futex_wait(w.futex_word_, 0, &ts);
+
+            if (w.futex_word_.load(std::memory_order::acquire) == 0 && clock::now() >= deadline)
+            {
+                if (try_retire(w))
+                {
+                    return false;
+                }
+                deadline = clock::now() + timeout;
+            }
+        }
+        return true;
+    }
+
+    // Work showed up while registering, withdraw unless a producer already
+    // claimed this worker, in which case it has also fixed up sleeping_.
+    std::scoped_lock lk{idle_mtx_};
+    auto pos = std::find(idle_workers_.begin(), idle_workers_.end(), &w);
+    if (pos != idle_workers_.end())
+    {
+        idle_workers_.erase(pos);
+        sleeping_.fetch_sub(1, std::memory_order::seq_cst);
+    }
+    return true;
+}
+
+bool ThreadPool::try_retire(worker& w) noexcept
+{
+    if (w.info_.idx < opts_.thread_count)
+    {
+        return false;
+    }
+
+    {
+        std::scoped_lock lk{idle_mtx_};
+        uint32_t live = live_.load(std::memory_order::seq_cst);
+        if (live <= opts_.thread_count + blocked_.load(std::memory_order::seq_cst))
+        {
+            return false;
+        }
+
+        // Not listed any more means a producer claimed this worker and is
+        // about to unpark it.
+        auto pos = std::find(idle_workers_.begin(), idle_workers_.end(), &w);
+        if (pos == idle_workers_.end() || !live_.compare_exchange_strong(live, live - 1, std::memory_order::seq_cst))
+        {
+            return false;
+        }
+
+        idle_workers_.erase(pos);
+        sleeping_.fetch_sub(1, std::memory_order::seq_cst);
+    }
+
+    // A producer may have counted on this worker between the timeout and
+    // the withdrawal, hand its work to someone else.
+    if (has_queued())
+    {
+        notify_workers();
+    }
+    return true;
+}
+
+void ThreadPool::notify_workers(std::size_t count) noexcept
+{
+    // Orders the caller's queue push before the sleeping_ load, pairs with park().
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    while (count > 0 && sleeping_.load(std::memory_order::seq_cst) > 0)
+    {
+        // Claim a handful under the lock, issue the futex wakes outside of it.
+        std::array<worker*, 16> batch{};
+        std::size_t claimed{0};
+        {
+            std::scoped_lock lk{idle_mtx_};
+            while (claimed < batch.size() && claimed < count && !idle_workers_.empty())
+            {
+                batch[claimed++] = idle_workers_.back();
+                idle_workers_.pop_back();
+                sleeping_.fetch_sub(1, std::memory_order::seq_cst);
+            }
+        }
+
+        if (claimed == 0)
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < claimed; ++i)
+        {
+            batch[i]->futex_word_.store(1, std::memory_order::release);
+            detail::futex_wake(batch[i]->futex_word_);
+        }
+        count -= claimed;
+    }
+}
+
+void ThreadPool::unpark_all() noexcept
+{
+    std::scoped_lock lk{idle_mtx_};
+    for (worker* w : idle_workers_)
+    {
+        sleeping_.fetch_sub(1, std::memory_order::seq_cst);
+        w->futex_word_.store(1, std::memory_order::release);
+        detail::futex_wake(w->futex_word_);
+    }
+    idle_workers_.clear();
+}
+
+void ThreadPool::_schedule(std::coroutine_handle<> handle, Priority priority, bool lifo) noexcept
 {
     if (handle == nullptr)
     {
         return;
     }
 
+    const auto cls = static_cast<std::size_t>(priority);
+    if (worker* w = local_worker(); lifo && w != nullptr && opts_.lifo_budget > 0)
+    {
+        flush_lifo_slot(*w);
+        w->lifo_slot_ = stamp(handle);
+        w->lifo_cls_ = cls;
+        return;
+    }
+
+    enqueue(stamp(handle), cls);
+}
+
+void ThreadPool::enqueue(queued_handle item, std::size_t cls) noexcept
+{
+    if (worker* w = local_worker(); w != nullptr)
     {
-        std::scoped_lock lk{wait_mtx_};
-        queue_.emplace_back(handle);
+        w->local_queues_[cls].push(item);
+    }
+    else
+    {
+        inject(caller_injection_queue(), cls, item);
     }
 
-    wait_cv_.notify_one();
+    notify_workers();
+}
+
+bool ThreadPool::throttle(operation& op) noexcept
+{
+    if (!above_high_water())
+    {
+        return false;
+    }
+
+    {
+        std::scoped_lock lk{throttle_mtx_};
+        op.next_ = nullptr;
+        if (throttled_tail_ != nullptr)
+        {
+            throttled_tail_->next_ = &op;
+        }
+        else
+        {
+            throttled_head_ = &op;
+        }
+        throttled_tail_ = &op;
+        throttled_count_.fetch_add(1, std::memory_order::seq_cst);
+    }
+
+    // Pairs with dequeued(): either it sees this waiter or this sees the
+    // drained queues, otherwise the last dequeue could miss the waiter.
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    if (queue_size() < opts_.low_water_mark)
+    {
+        release_throttled();
+    }
+    return true;
+}
+
+void ThreadPool::release_throttled() noexcept
+{
+    while (true)
+    {
+        // The awaiters live in their coroutine frames, which may be gone as
+        // soon as the coroutine is scheduled, so copy out what is needed.
+        std::array<std::pair<std::coroutine_handle<>, Priority>, 16> batch{};
+        std::size_t released{0};
+        {
+            std::scoped_lock lk{throttle_mtx_};
+            const std::size_t depth = queue_size();
+            const std::size_t room = depth < opts_.high_water_mark ? opts_.high_water_mark - depth : 0;
+            while (released < batch.size() && released < room && throttled_head_ != nullptr)
+            {
+                operation* op = throttled_head_;
+                throttled_head_ = op->next_;
+                if (throttled_head_ == nullptr)
+                {
+                    throttled_tail_ = nullptr;
+                }
+                batch[released++] = {op->awaiting_coroutine_, op->priority_};
+                throttled_count_.fetch_sub(1, std::memory_order::seq_cst);
+            }
+        }
+
+        if (released == 0)
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < released; ++i)
+        {
+            _schedule(batch[i].first, batch[i].second);
+        }
+    }
+}
+
+void ThreadPool::dequeued() noexcept
+{
+    // Only backpressure needs shared state on a dequeue, the depth is summed
+    // from the queues themselves when someone asks for it.
+    if (opts_.high_water_mark == 0)
+    {
+        return;
+    }
+
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    if (throttled_count_.load(std::memory_order::relaxed) > 0 && queue_size() < opts_.low_water_mark)
+    {
+        release_throttled();
+    }
 }
 
 }